@@ -0,0 +1,232 @@
+/* Built-in actions, run in the daemon instead of forking xinput et al
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <X11/Xatom.h>
+#include "xplugd.h"
+
+/* Values for set-prop, converted when the rule is read */
+struct prop {
+	Atom          atom;
+	Atom          float_atom;
+	int           num;
+	long          ival[RULE_MAX_ARGS];
+	float         fval[RULE_MAX_ARGS];
+	Atom          aval[RULE_MAX_ARGS];	/* None if value is a number */
+};
+
+/* Atoms for map-to-output */
+struct matrix {
+	Atom          atom;
+	Atom          float_atom;
+};
+
+static int device_id(struct event *ev)
+{
+	if (!ev->input) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return atoi(ev->device);
+}
+
+static int set_prop_init(Display *dpy, struct rule *r)
+{
+	struct prop *p;
+	int i;
+
+	if (r->argc < 2)
+		return -1;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return -1;
+
+	p->atom = XInternAtom(dpy, r->argv[0], False);
+	p->num  = r->argc - 1;
+	for (i = 0; i < p->num; i++) {
+		char *arg = r->argv[i + 1], *end;
+
+		p->ival[i] = strtol(arg, &end, 0);
+		p->fval[i] = strtof(arg, NULL);
+		if (*end && *end != '.')
+			p->aval[i] = XInternAtom(dpy, arg, False);
+	}
+	p->float_atom = XInternAtom(dpy, "FLOAT", False);
+
+	r->priv = p;
+
+	return 0;
+}
+
+/*
+ * Like xinput set-prop, the property must exist.  Its type and format
+ * is read from the device, without any data, and the values given in
+ * the rule converted accordingly.
+ */
+static int set_prop_run(Display *dpy, struct rule *r, struct event *ev)
+{
+	unsigned long nitems, bytes_after;
+	unsigned char *data = NULL;
+	struct prop *p = r->priv;
+	union {
+		int8_t  b[RULE_MAX_ARGS];
+		int16_t s[RULE_MAX_ARGS];
+		int32_t l[RULE_MAX_ARGS];
+		float   f[RULE_MAX_ARGS];
+	} buf;
+	int id, format, i;
+	Atom type;
+
+	id = device_id(ev);
+	if (id < 0)
+		return -1;
+
+	if (XIGetProperty(dpy, id, p->atom, 0, 0, False, AnyPropertyType, &type, &format,
+			  &nitems, &bytes_after, &data) != Success)
+		return -1;
+	if (data)
+		XFree(data);
+
+	if (type == None) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	for (i = 0; i < p->num; i++) {
+		if (type == p->float_atom && format == 32) {
+			buf.f[i] = p->fval[i];
+		} else if (type == XA_ATOM && format == 32) {
+			buf.l[i] = p->aval[i];
+		} else if (type == XA_INTEGER || type == XA_CARDINAL) {
+			switch (format) {
+			case 8:
+				buf.b[i] = p->ival[i];
+				break;
+			case 16:
+				buf.s[i] = p->ival[i];
+				break;
+			default:
+				buf.l[i] = p->ival[i];
+				break;
+			}
+		} else {
+			errno = ENOTSUP;
+			return -1;
+		}
+	}
+
+	XIChangeProperty(dpy, id, p->atom, type, format, PropModeReplace, (unsigned char *)&buf, p->num);
+
+	return 0;
+}
+
+static int map_to_output_init(Display *dpy, struct rule *r)
+{
+	struct matrix *mx;
+
+	if (r->argc != 1)
+		return -1;
+
+	mx = calloc(1, sizeof(*mx));
+	if (!mx)
+		return -1;
+
+	mx->atom       = XInternAtom(dpy, "Coordinate Transformation Matrix", False);
+	mx->float_atom = XInternAtom(dpy, "FLOAT", False);
+	r->priv = mx;
+
+	return 0;
+}
+
+/*
+ * Restrict an absolute device to one output, the same matrix as
+ * xinput map-to-output, computed from the cached CRTC geometry and
+ * the size of the output's screen.
+ */
+static int map_to_output_run(Display *dpy, struct rule *r, struct event *ev)
+{
+	struct matrix *mx = r->priv;
+	struct xplugd_output *outputs;
+	float w, h, m[9];
+	int id, i, num, sw, sh;
+
+	id = device_id(ev);
+	if (id < 0)
+		return -1;
+
+	outputs = randr_outputs(&num);
+	for (i = 0; i < num; i++) {
+		if (!strcmp(outputs[i].name, r->argv[0]))
+			break;
+	}
+	if (i == num || !outputs[i].crtc) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	randr_screen_size(dpy, outputs[i].screen, &sw, &sh);
+	w = sw;
+	h = sh;
+	memset(m, 0, sizeof(m));
+	m[0] = outputs[i].width / w;
+	m[2] = outputs[i].x / w;
+	m[4] = outputs[i].height / h;
+	m[5] = outputs[i].y / h;
+	m[8] = 1.0;
+
+	XIChangeProperty(dpy, id, mx->atom, mx->float_atom, 32, PropModeReplace, (unsigned char *)m, 9);
+
+	return 0;
+}
+
+static void priv_free(struct rule *r)
+{
+	free(r->priv);
+}
+
+static const struct action actions[] = {
+	{ "set-prop",      set_prop_init,      set_prop_run,      priv_free },
+	{ "map-to-output", map_to_output_init, map_to_output_run, priv_free },
+	{ "xkb",           xkb_init,           xkb_run,           NULL      },
+	{ "seat",          seat_init,          seat_run,          NULL      },
+	{ "dpi",           dpi_init,           dpi_run,           NULL      },
+	{ "gamma",         gamma_init,         gamma_run,         gamma_exit },
+	{ NULL, NULL, NULL, NULL }
+};
+
+const struct action *action_find(const char *name)
+{
+	for (int i = 0; actions[i].name; i++) {
+		if (!strcmp(actions[i].name, name))
+			return &actions[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,130 @@
+/* Per-event arena, temporary data freed all at once when an event is done
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Everything built for one event, e.g. the script environment or a
+ * rewritten resource property, is taken from a static block instead of
+ * the heap, and dropped with arena_reset() when notify() is done with
+ * the event.  Requests that do not fit in what is left of the block get
+ * their own heap chunk, freed by the same reset, so nothing built for
+ * an event outlives it, and the block is reused by every event.
+ */
+
+#include <stdarg.h>
+#include "xplugd.h"
+
+#define ARENA_ALIGN  16
+#define ALIGN(len)   (((len) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct chunk {
+	struct chunk *next;
+	long double   data[];		/* Aligned for any type */
+};
+
+static union {
+	char          buf[ARENA_SIZE];
+	long double   align;
+} block;
+static size_t used;
+static struct chunk *chunks;
+
+/*
+ * Allocate @len bytes for the current event, returns NULL and sets
+ * errno if the heap is needed and fails
+ */
+void *arena_alloc(size_t len)
+{
+	struct chunk *c;
+
+	len = ALIGN(len ? len : 1);
+	if (len <= sizeof(block.buf) - used) {
+		void *p = &block.buf[used];
+
+		used += len;
+		return p;
+	}
+
+	c = malloc(sizeof(*c) + len);
+	if (!c)
+		return NULL;
+
+	syslog(LOG_DEBUG, "Arena full, %zu bytes from the heap", len);
+	c->next = chunks;
+	chunks  = c;
+
+	return c->data;
+}
+
+/*
+ * Format a string for the current event
+ */
+char *arena_printf(const char *fmt, ...)
+{
+	va_list ap;
+	char *p;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return NULL;
+
+	p = arena_alloc(len + 1);
+	if (!p)
+		return NULL;
+
+	va_start(ap, fmt);
+	vsnprintf(p, len + 1, fmt, ap);
+	va_end(ap);
+
+	return p;
+}
+
+/*
+ * Bytes taken from the static block since the last reset
+ */
+size_t arena_used(void)
+{
+	return used;
+}
+
+/*
+ * Drop everything allocated since the last reset
+ */
+void arena_reset(void)
+{
+	while (chunks) {
+		struct chunk *c = chunks;
+
+		chunks = c->next;
+		free(c);
+	}
+	used = 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
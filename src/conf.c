@@ -0,0 +1,695 @@
+/* Configuration file, rules with built-in actions
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Each line in the configuration file is a rule:
+ *
+ *    TYPE STATUS NAME ACTION [ARG ...]
+ *
+ * TYPE and STATUS are as passed to the script, or "*", NAME is a shell
+ * glob matched against the input device name, or the output name for
+ * display events.  Fields with spaces are quoted, '#' starts a comment:
+ *
+ *    pointer connected "SynPS/2 Synaptics TouchPad" set-prop "Synaptics Off" 1
+ *    pointer connected "Wacom*"                     map-to-output HDMI-1
+ *
+ * Display rules may also match on EDID, before the action:
+ *
+ *    display connected * vendor=DEL model="DELL U2720Q" serial=1234 exec
+ *
+ * and input rules on USB id, device node, and capabilities, which tell
+ * identical devices apart:
+ *
+ *    keyboard connected * usb=04d9:* node=/dev/input/event* caps=keys xkb layout=se
+ *
+ * Actions are prepared when the file is read, e.g. atoms are interned,
+ * and run in the daemon on matching events.  The actions exec and none
+ * decide if the script is called, the first matching one wins.  If no
+ * rule decides, the default is used, set with "default exec|none".
+ *
+ * Plugins, see plugin.h, are loaded with:
+ *
+ *    plugin /path/to/foo.so [ARG ...]
+ *
+ * and GPU providers paired for PRIME, the sink's outputs driven by the
+ * source, see prime.c, with:
+ *
+ *    prime SOURCE SINK
+ *
+ * Bad DisplayPort links are only retrained, see link.c, with:
+ *
+ *    retrain
+ *
+ * Rules are compiled, per TYPE and STATUS, the first time an event of
+ * that kind is seen: a hash table bucket with a prefix trie of the
+ * literal start of all NAME globs.  So an event is matched only with
+ * the few rules that can possibly match it.
+ *
+ * Actions hold atoms and keymaps of the server, so each display reads
+ * the file into its own set of rules.  Plugins are loaded only once.
+ */
+
+#include <fnmatch.h>
+#include <strings.h>
+#include "xplugd.h"
+
+/* Prefix trie node, rules are listed at the node their prefix ends */
+struct trie {
+	char          c;
+	struct trie  *child;
+	struct trie  *sibling;
+
+	int           num;
+	struct rule **rules;
+};
+
+struct bucket {
+	char          type[16];
+	char          status[16];
+	struct trie   root;
+	struct bucket *next;
+};
+
+/* Rules of one display */
+struct conf {
+	Display       *dpy;
+	struct rule   *rules;
+	enum verdict   defverdict;
+	struct bucket *buckets[RULE_BUCKETS];
+	struct rule  **matched;		/* Candidates, room for all rules */
+	int            num_rules;
+
+	struct prime   prime[PRIME_MAX];
+	int            num_prime;
+	int            retrain;
+};
+
+static int plugins_loaded;
+
+/*
+ * Split @line into at most @max tokens, in place.  Handles single and
+ * double quotes, and stops at an unquoted '#'.
+ */
+static int tokenize(char *line, char *argv[], int max)
+{
+	char *src = line, *dst = line;
+	int argc = 0;
+
+	while (*src) {
+		char quote = 0;
+
+		while (*src == ' ' || *src == '\t' || *src == '\r' || *src == '\n')
+			src++;
+		if (!*src || *src == '#')
+			break;
+
+		if (argc >= max)
+			return -1;
+		argv[argc++] = dst;
+
+		while (*src) {
+			if (quote) {
+				if (*src == quote) {
+					quote = 0;
+					src++;
+					continue;
+				}
+			} else if (*src == '"' || *src == '\'') {
+				quote = *src++;
+				continue;
+			} else if (*src == ' ' || *src == '\t' || *src == '\r' || *src == '\n') {
+				break;
+			}
+			*dst++ = *src++;
+		}
+
+		if (*src)
+			src++;
+		*dst++ = 0;
+
+		if (quote)
+			return -1;
+	}
+
+	return argc;
+}
+
+/*
+ * VENDOR:PRODUCT in hex, like lsusb, either may be "*"
+ */
+static int usb_parse(const char *arg, struct rule *r)
+{
+	const char *product;
+	char *end;
+
+	product = strchr(arg, ':');
+	if (!product)
+		return -1;
+	product++;
+
+	if (arg[0] == '*' && arg[1] == ':') {
+		r->usb_vendor = 0;
+	} else {
+		r->usb_vendor = strtoul(arg, &end, 16);
+		if (end != product - 1 || !r->usb_vendor)
+			return -1;
+	}
+
+	if (!strcmp(product, "*")) {
+		r->usb_product = 0;
+	} else {
+		r->usb_product = strtoul(product, &end, 16);
+		if (*end || !r->usb_product)
+			return -1;
+	}
+
+	return 0;
+}
+
+static struct rule *parse(struct conf *cf, char *line, const char *file, int lineno)
+{
+	char *argv[RULE_MAX_ARGS + 4];
+	struct rule *r;
+	int argc, i;
+
+	argc = tokenize(line, argv, sizeof(argv) / sizeof(argv[0]));
+	if (!argc)
+		return NULL;
+	if (argc < 0) {
+		syslog(LOG_WARNING, "%s:%d: unbalanced quotes or too many arguments", file, lineno);
+		return NULL;
+	}
+	if (!strcmp(argv[0], "plugin")) {
+		char *args[RULE_MAX_ARGS + 4];
+
+		if (argc < 2) {
+			syslog(LOG_WARNING, "%s:%d: missing plugin path", file, lineno);
+			return NULL;
+		}
+
+		if (plugins_loaded)
+			return NULL;
+
+		/* Plugins may keep their arguments */
+		for (i = 1; i < argc; i++)
+			args[i - 1] = strdup(argv[i]);
+		plugin_load(cf->dpy, args[0], argc - 1, args);
+		return NULL;
+	}
+	if (!strcmp(argv[0], "prime")) {
+		struct prime *p;
+
+		if (argc != 3) {
+			syslog(LOG_WARNING, "%s:%d: prime needs SOURCE and SINK provider", file, lineno);
+			return NULL;
+		}
+		if (cf->num_prime >= PRIME_MAX) {
+			syslog(LOG_WARNING, "%s:%d: too many provider pairs, max %d", file, lineno, PRIME_MAX);
+			return NULL;
+		}
+
+		p = &cf->prime[cf->num_prime++];
+		snprintf(p->source, sizeof(p->source), "%s", argv[1]);
+		snprintf(p->sink,   sizeof(p->sink),   "%s", argv[2]);
+		return NULL;
+	}
+	if (!strcmp(argv[0], "retrain")) {
+		if (argc != 1)
+			syslog(LOG_WARNING, "%s:%d: retrain takes no arguments", file, lineno);
+		cf->retrain = 1;
+		return NULL;
+	}
+	if (!strcmp(argv[0], "default")) {
+		if (argc == 2 && !strcmp(argv[1], "exec"))
+			cf->defverdict = VERDICT_EXEC;
+		else if (argc == 2 && !strcmp(argv[1], "none"))
+			cf->defverdict = VERDICT_NONE;
+		else
+			syslog(LOG_WARNING, "%s:%d: default must be exec or none", file, lineno);
+		return NULL;
+	}
+	if (argc < 4) {
+		syslog(LOG_WARNING, "%s:%d: need at least TYPE STATUS NAME ACTION", file, lineno);
+		return NULL;
+	}
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	snprintf(r->type,   sizeof(r->type),   "%s", argv[0]);
+	snprintf(r->status, sizeof(r->status), "%s", argv[1]);
+	snprintf(r->glob,   sizeof(r->glob),   "%s", argv[2]);
+	r->lineno = lineno;
+
+	for (i = 3; i < argc; i++) {
+		if (!strncmp(argv[i], "vendor=", 7)) {
+			snprintf(r->vendor, sizeof(r->vendor), "%s", &argv[i][7]);
+		} else if (!strncmp(argv[i], "model=", 6)) {
+			snprintf(r->model, sizeof(r->model), "%s", &argv[i][6]);
+		} else if (!strncmp(argv[i], "serial=", 7)) {
+			r->serial = strtoul(&argv[i][7], NULL, 0);
+		} else if (!strncmp(argv[i], "usb=", 4)) {
+			if (usb_parse(&argv[i][4], r)) {
+				syslog(LOG_WARNING, "%s:%d: usb= must be VENDOR:PRODUCT in hex", file, lineno);
+				goto fail;
+			}
+		} else if (!strncmp(argv[i], "node=", 5)) {
+			snprintf(r->node, sizeof(r->node), "%s", &argv[i][5]);
+		} else if (!strncmp(argv[i], "caps=", 5)) {
+			if (input_caps_parse(&argv[i][5], &r->caps)) {
+				syslog(LOG_WARNING, "%s:%d: unknown capability in %s", file, lineno, argv[i]);
+				goto fail;
+			}
+		} else {
+			break;
+		}
+	}
+	if (i == argc) {
+		syslog(LOG_WARNING, "%s:%d: missing action", file, lineno);
+		goto fail;
+	}
+
+	if (!strcmp(argv[i], "exec")) {
+		r->verdict = VERDICT_EXEC;
+	} else if (!strcmp(argv[i], "none")) {
+		r->verdict = VERDICT_NONE;
+	} else {
+		r->action = action_find(argv[i]);
+		if (!r->action) {
+			syslog(LOG_WARNING, "%s:%d: unknown action %s", file, lineno, argv[i]);
+			goto fail;
+		}
+	}
+
+	for (i++; i < argc; i++) {
+		r->argv[r->argc] = strdup(argv[i]);
+		if (!r->argv[r->argc])
+			goto fail;
+		r->argc++;
+	}
+
+	if (r->action && r->action->init && r->action->init(cf->dpy, r)) {
+		syslog(LOG_WARNING, "%s:%d: invalid arguments to %s", file, lineno, r->action->name);
+		goto fail;
+	}
+
+	return r;
+fail:
+	for (i = 0; i < r->argc; i++)
+		free(r->argv[i]);
+	free(r);
+	return NULL;
+}
+
+static int match(const char *filter, const char *value)
+{
+	if (!strcmp(filter, "*"))
+		return 1;
+
+	return !fnmatch(filter, value ? value : "", 0);
+}
+
+static unsigned int hash(const char *type, const char *status)
+{
+	unsigned int h = 5381;
+
+	while (*type)
+		h = h * 33 + *type++;
+	h = h * 33 + '/';
+	while (*status)
+		h = h * 33 + *status++;
+
+	return h & (RULE_BUCKETS - 1);
+}
+
+static struct trie *trie_insert(struct trie *node, const char *glob, struct rule *r)
+{
+	struct rule **rules;
+
+	/* Walk the literal prefix of the glob */
+	for (; *glob && !strchr("*?[\\", *glob); glob++) {
+		struct trie *child;
+
+		for (child = node->child; child; child = child->sibling) {
+			if (child->c == *glob)
+				break;
+		}
+
+		if (!child) {
+			child = calloc(1, sizeof(*child));
+			if (!child)
+				return NULL;
+			child->c       = *glob;
+			child->sibling = node->child;
+			node->child    = child;
+		}
+		node = child;
+	}
+
+	rules = realloc(node->rules, (node->num + 1) * sizeof(r));
+	if (!rules)
+		return NULL;
+	rules[node->num++] = r;
+	node->rules = rules;
+
+	return node;
+}
+
+/*
+ * Compile bucket for events of @type and @status, with all rules that
+ * can match them, in file order.
+ */
+static struct bucket *compile(struct conf *cf, const char *type, const char *status)
+{
+	struct bucket *b;
+	struct rule *r;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return NULL;
+
+	snprintf(b->type, sizeof(b->type), "%s", type);
+	snprintf(b->status, sizeof(b->status), "%s", status);
+	for (r = cf->rules; r; r = r->next) {
+		if (!match(r->type, type) || !match(r->status, status))
+			continue;
+
+		if (!trie_insert(&b->root, r->glob, r))
+			syslog(LOG_ERR, "Failed compiling rule on line %d: %s", r->lineno, strerror(errno));
+	}
+
+	return b;
+}
+
+static struct bucket *lookup(struct conf *cf, const char *type, const char *status)
+{
+	unsigned int h = hash(type, status);
+	struct bucket *b;
+
+	for (b = cf->buckets[h]; b; b = b->next) {
+		if (!strcmp(b->type, type) && !strcmp(b->status, status))
+			return b;
+	}
+
+	b = compile(cf, type, status);
+	if (!b)
+		return NULL;
+
+	b->next = cf->buckets[h];
+	cf->buckets[h] = b;
+
+	return b;
+}
+
+static int edid_match(struct rule *r, const struct xplugd_output *o)
+{
+	if (!r->vendor[0] && !r->model[0] && !r->serial)
+		return 1;
+	if (!o)
+		return 0;
+
+	if (r->vendor[0] && strcasecmp(r->vendor, o->vendor))
+		return 0;
+	if (r->model[0] && fnmatch(r->model, o->model, 0))
+		return 0;
+	if (r->serial && r->serial != o->serial)
+		return 0;
+
+	return 1;
+}
+
+static int device_match(struct rule *r, struct event *ev)
+{
+	const struct xplugd_device *dev;
+
+	if (!r->usb_vendor && !r->usb_product && !r->node[0] && !r->caps)
+		return 1;
+	if (!ev->input)
+		return 0;
+
+	dev = input_device(atoi(ev->device));
+	if (!dev)
+		return 0;
+
+	if (r->usb_vendor && r->usb_vendor != dev->vendor_id)
+		return 0;
+	if (r->usb_product && r->usb_product != dev->product_id)
+		return 0;
+	if (r->node[0] && fnmatch(r->node, dev->node, 0))
+		return 0;
+	if ((dev->caps & r->caps) != r->caps)
+		return 0;
+
+	return 1;
+}
+
+static int compare(const void *a, const void *b)
+{
+	const struct rule *ra = *(const struct rule **)a;
+	const struct rule *rb = *(const struct rule **)b;
+
+	return ra->lineno - rb->lineno;
+}
+
+/*
+ * Run the built-in actions of all rules matching @ev, in file order.
+ * Returns 1 if the script should be called, otherwise 0.
+ */
+int conf_run(struct event *ev)
+{
+	enum verdict verdict = VERDICT_BUILTIN;
+	struct conf *cf = xd->conf;
+	struct rule **matched;
+	struct trie *node;
+	struct bucket *b;
+	const char *name, *p;
+	int i, num = 0;
+
+	if (!cf)
+		return 1;
+	if (!cf->rules)
+		return cf->defverdict == VERDICT_EXEC;
+
+	b = lookup(cf, ev->type, ev->status);
+	if (!b)
+		return cf->defverdict == VERDICT_EXEC;
+	matched = cf->matched;
+
+	/* Inputs match on device name, displays on output name */
+	name = ev->input ? ev->name : ev->device;
+	if (!name)
+		name = "";
+
+	/* Collect candidates along the path of the name in the trie */
+	node = &b->root;
+	for (p = name; node; p++) {
+		for (i = 0; i < node->num && num < cf->num_rules; i++)
+			matched[num++] = node->rules[i];
+
+		if (!*p)
+			break;
+		for (node = node->child; node; node = node->sibling) {
+			if (node->c == *p)
+				break;
+		}
+	}
+	qsort(matched, num, sizeof(matched[0]), compare);
+
+	for (i = 0; i < num; i++) {
+		struct rule *r = matched[i];
+
+		if (fnmatch(r->glob, name, 0) || !edid_match(r, ev->output) || !device_match(r, ev))
+			continue;
+
+		if (r->verdict != VERDICT_BUILTIN) {
+			if (verdict == VERDICT_BUILTIN)
+				verdict = r->verdict;
+			continue;
+		}
+
+		syslog(LOG_DEBUG, "Rule on line %d matches %s %s, running %s", r->lineno,
+		       ev->type, ev->device, r->action->name);
+		if (r->action->run(cf->dpy, r, ev))
+			syslog(LOG_WARNING, "Failed %s for %s %s: %s", r->action->name,
+			       ev->type, name, strerror(errno));
+	}
+
+	if (verdict == VERDICT_BUILTIN)
+		verdict = cf->defverdict;
+
+	return verdict == VERDICT_EXEC;
+}
+
+/*
+ * Check if any rule names event @type, "*" does not count, so the
+ * optional RandR events are only selected if explicitly asked for
+ */
+int conf_wants(const char *type)
+{
+	struct conf *cf = xd->conf;
+	struct rule *r;
+
+	if (!cf)
+		return 0;
+
+	for (r = cf->rules; r; r = r->next) {
+		if (strcmp(r->type, "*") && !fnmatch(r->type, type, 0))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Provider pairs of the current display, NULL if none
+ */
+const struct prime *conf_prime(int *num)
+{
+	struct conf *cf = xd->conf;
+
+	if (!cf || !cf->num_prime) {
+		*num = 0;
+		return NULL;
+	}
+
+	*num = cf->num_prime;
+	return cf->prime;
+}
+
+/*
+ * Retrain bad DisplayPort links of the current display
+ */
+int conf_retrain(void)
+{
+	return xd->conf && xd->conf->retrain;
+}
+
+int conf_init(Display *dpy, const char *file)
+{
+	struct rule **tail;
+	struct conf *cf;
+	char line[512];
+	int lineno = 0;
+	FILE *fp;
+
+	fp = fopen(file, "r");
+	if (!fp) {
+		if (errno == ENOENT)
+			return 0;
+		syslog(LOG_ERR, "Failed reading %s: %s", file, strerror(errno));
+		return -1;
+	}
+
+	cf = calloc(1, sizeof(*cf));
+	if (!cf) {
+		fclose(fp);
+		return -1;
+	}
+	cf->dpy        = dpy;
+	cf->defverdict = VERDICT_EXEC;
+	tail = &cf->rules;
+
+	while (fgets(line, sizeof(line), fp)) {
+		struct rule *r;
+
+		r = parse(cf, line, file, ++lineno);
+		if (!r)
+			continue;
+
+		*tail = r;
+		tail = &r->next;
+		cf->num_rules++;
+	}
+	fclose(fp);
+
+	plugins_loaded = 1;
+	xd->conf = cf;
+
+	/* A rule is in one trie node, an event cannot match more than all */
+	if (cf->num_rules) {
+		cf->matched = calloc(cf->num_rules, sizeof(cf->matched[0]));
+		if (!cf->matched) {
+			conf_exit();
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void trie_free(struct trie *node)
+{
+	while (node) {
+		struct trie *sibling = node->sibling;
+
+		trie_free(node->child);
+		free(node->rules);
+		free(node);
+		node = sibling;
+	}
+}
+
+/*
+ * Free the rules of the current display, when it is closed
+ */
+void conf_exit(void)
+{
+	struct conf *cf = xd->conf;
+	int i;
+
+	if (!cf)
+		return;
+
+	for (i = 0; i < RULE_BUCKETS; i++) {
+		while (cf->buckets[i]) {
+			struct bucket *b = cf->buckets[i];
+
+			cf->buckets[i] = b->next;
+			trie_free(b->root.child);
+			free(b->root.rules);
+			free(b);
+		}
+	}
+
+	while (cf->rules) {
+		struct rule *r = cf->rules;
+
+		cf->rules = r->next;
+		if (r->action && r->action->exit)
+			r->action->exit(r);
+		for (i = 0; i < r->argc; i++)
+			free(r->argv[i]);
+		free(r);
+	}
+
+	free(cf->matched);
+	free(cf);
+	xd->conf = NULL;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
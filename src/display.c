@@ -0,0 +1,587 @@
+/* X displays, one or many per daemon
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Each X connection is registered with the main loop and has its own
+ * struct xdisplay with everything that depends on the server.  Before
+ * events from a display are handled xd is set to it, so the modules,
+ * and the script, always see the display the event came from.
+ *
+ * With a watched directory, e.g. /tmp/.X11-unix, new local servers are
+ * picked up as soon as their socket appears.  A server that has just
+ * created its socket may not accept connections yet, so failed opens
+ * are retried a few times.  Displays that go away are dropped when
+ * their connection is lost.
+ *
+ * Local displays given with -r are reopened the same way when their
+ * server restarts, only /tmp/.X11-unix is watched for them.  All other
+ * daemon state, the script, rules, and socket clients, stays as is.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include "xplugd.h"
+
+struct pending {
+	char          name[64];
+	int           retries;
+	struct timespec when;
+};
+
+/* Display to reopen when socket X<N> appears */
+struct reconnect {
+	char          name[64];		/* As given, for socket clients */
+	char          local[16];	/* :<N> */
+};
+
+struct xdisplay *xd;
+
+static struct xdisplay *displays;
+static struct pending pending[DISPLAY_MAX_PENDING];
+static int num_pending;
+static struct reconnect reconnect[DISPLAY_MAX_ARGS];
+static int num_reconnect;
+static int watch_sd = -1;
+static int watch_all;
+
+/*
+ * Handle all events the X server has sent, and Xlib has queued, for @d
+ */
+static void drain(struct xdisplay *d)
+{
+	XEvent ev;
+	int num = 0;
+
+	xd = d;
+	while (XPending(d->dpy)) {
+		XNextEvent(d->dpy, &ev);
+		d->screen = DefaultScreen(d->dpy);
+
+		if (is_input_event(d->dpy, &ev))
+			input_event(d->dpy, &ev);
+		else
+			randr_event(d->dpy, &ev);
+		num++;
+	}
+
+	if (num)
+		snapshot_update();
+}
+
+static void display_read(int fd, void *arg)
+{
+	drain(arg);
+}
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+/*
+ * Called by Xlib instead of exit() when the connection is lost, after
+ * our I/O error handler.  Returning leaves the Display unusable, but
+ * safe to call, it is dropped by display_dispatch().
+ */
+static void display_lost(Display *dpy, void *arg)
+{
+}
+#endif
+
+/*
+ * A connection over a unix socket is to a server on this host, only
+ * then does the kernel's view of the GPUs, e.g. sysfs, apply to it.
+ * Forwarded (ssh -X) and TCP displays are remote.
+ */
+int display_local(Display *dpy)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+
+	if (getsockname(ConnectionNumber(dpy), (struct sockaddr *)&ss, &len))
+		return 0;
+
+	return ss.ss_family == AF_UNIX;
+}
+
+/*
+ * Set up all modules for an open X connection, returns NULL if the
+ * server lacks something we need
+ */
+struct xdisplay *display_add(Display *dpy)
+{
+	struct xdisplay *d;
+	int i;
+
+	d = calloc(1, sizeof(*d));
+	if (!d)
+		return NULL;
+
+	snprintf(d->name, sizeof(d->name), "%s", DisplayString(dpy));
+	d->dpy   = dpy;
+	d->local = display_local(dpy);
+	d->next  = displays;
+	displays = d;
+	xd = d;
+
+	/* Zaphod multi-head has one screen, and root window, per head */
+	d->num_screens = ScreenCount(dpy);
+	if (d->num_screens > MAX_SCREENS) {
+		syslog(LOG_WARNING, "%s has %d screens, only watching the first %d", d->name,
+		       d->num_screens, MAX_SCREENS);
+		d->num_screens = MAX_SCREENS;
+	}
+	for (i = 0; i < d->num_screens; i++)
+		d->screens[i].root = RootWindow(dpy, i);
+	d->screen = DefaultScreen(dpy);
+
+	/* Scripts must not inherit any of our X connections */
+	fcntl(ConnectionNumber(dpy), F_SETFD, FD_CLOEXEC);
+#ifdef HAVE_XSETIOERROREXITHANDLER
+	XSetIOErrorExitHandler(dpy, display_lost, d);
+#endif
+
+	if (loop_add(ConnectionNumber(dpy), display_read, d)) {
+		syslog(LOG_ERR, "Too many open files, cannot watch %s", d->name);
+		goto fail;
+	}
+	if (input_init(dpy) || randr_init(dpy)) {
+		loop_del(ConnectionNumber(dpy));
+		goto fail;
+	}
+	if (conffile)
+		conf_init(dpy, conffile);
+	randr_providers(dpy);
+	randr_select(dpy);
+	snapshot_init();
+	snapshot_reconcile();
+	snapshot_update();
+	XSync(dpy, False);
+
+	syslog(LOG_NOTICE, "Watching display %s", d->name);
+
+	return d;
+fail:
+	displays = d->next;
+	free(d);
+	xd = displays;
+	return NULL;
+}
+
+struct xdisplay *display_open(const char *name)
+{
+	struct xdisplay *d;
+	Display *dpy;
+
+	dpy = XOpenDisplay(name);
+	if (!dpy)
+		return NULL;
+
+	d = display_add(dpy);
+	if (!d)
+		XCloseDisplay(dpy);
+
+	return d;
+}
+
+/*
+ * Drop @d, and free all its state.  If the connection is lost, and Xlib
+ * has no exit handler, the Display cannot be closed, only its socket.
+ */
+void display_close(struct xdisplay *d)
+{
+	struct xdisplay **prev;
+	int fd = ConnectionNumber(d->dpy);
+
+	for (prev = &displays; *prev; prev = &(*prev)->next) {
+		if (*prev == d) {
+			*prev = d->next;
+			break;
+		}
+	}
+
+	syslog(LOG_NOTICE, "No longer watching display %s", d->name);
+	xd = d;
+	loop_del(fd);
+	conf_exit();
+	link_exit();
+	xkb_exit(d->dpy);
+	snapshot_exit();
+
+#ifndef HAVE_XSETIOERROREXITHANDLER
+	if (d->lost)
+		close(fd);
+	else
+#endif
+		XCloseDisplay(d->dpy);
+	free(d);
+
+	xd = displays;
+}
+
+struct xdisplay *display_find(Display *dpy)
+{
+	struct xdisplay *d;
+
+	for (d = displays; d; d = d->next) {
+		if (d->dpy == dpy)
+			return d;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find display by name, NULL for the first one
+ */
+struct xdisplay *display_lookup(const char *name)
+{
+	struct xdisplay *d;
+
+	if (!name || !name[0])
+		return displays;
+
+	for (d = displays; d; d = d->next) {
+		if (!strcmp(d->name, name))
+			return d;
+	}
+
+	return NULL;
+}
+
+struct xdisplay *display_list(void)
+{
+	return displays;
+}
+
+/*
+ * Name of screen @scr of @d, e.g. ":0.1", for clients that should use
+ * that screen.  With only one screen the display name is used as-is.
+ */
+int display_screen(struct xdisplay *d, int scr, char *buf, size_t len)
+{
+	const char *colon;
+	int n;
+
+	if (d->num_screens < 2) {
+		snprintf(buf, len, "%s", d->name);
+		return 0;
+	}
+
+	/* Strip any screen from the name, host:N.S */
+	colon = strrchr(d->name, ':');
+	if (!colon)
+		return -1;
+	n = colon - d->name + strcspn(colon, ".");
+
+	if (snprintf(buf, len, "%.*s.%d", n, d->name, scr) >= (int)len)
+		return -1;
+
+	return 0;
+}
+
+static int expired(const struct timespec *now, const struct timespec *when)
+{
+	return now->tv_sec > when->tv_sec || (now->tv_sec == when->tv_sec && now->tv_nsec >= when->tv_nsec);
+}
+
+static void retry_later(struct pending *p, const struct timespec *now)
+{
+	p->when = *now;
+	p->when.tv_nsec += DISPLAY_RETRY_MS * 1000000L;
+	while (p->when.tv_nsec >= 1000000000L) {
+		p->when.tv_sec++;
+		p->when.tv_nsec -= 1000000000L;
+	}
+}
+
+/*
+ * Open display @name now, or retry later if the server is not ready
+ */
+static void display_try(const char *name)
+{
+	struct timespec now;
+	struct xdisplay *d;
+	struct pending *p;
+	int i;
+
+	/* Restarted server, the old connection not yet dropped */
+	d = display_lookup(name);
+	if (d && !d->lost)
+		return;
+	if (!d && display_open(name))
+		return;
+
+	for (i = 0; i < num_pending; i++) {
+		if (!strcmp(pending[i].name, name))
+			return;
+	}
+	if (num_pending >= DISPLAY_MAX_PENDING) {
+		syslog(LOG_WARNING, "Cannot open display %s, giving up", name);
+		return;
+	}
+
+	p = &pending[num_pending++];
+	snprintf(p->name, sizeof(p->name), "%s", name);
+	p->retries = DISPLAY_RETRIES;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	retry_later(p, &now);
+}
+
+static void retry(void)
+{
+	struct timespec now;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < num_pending; i++) {
+		struct pending *p = &pending[i];
+
+		if (!expired(&now, &p->when))
+			continue;
+
+		if (!display_lookup(p->name) && !display_open(p->name) && --p->retries > 0) {
+			retry_later(p, &now);
+			continue;
+		}
+		if (p->retries <= 0)
+			syslog(LOG_WARNING, "Cannot open display %s, giving up", p->name);
+
+		pending[i--] = pending[--num_pending];
+	}
+}
+
+/*
+ * Called before each poll(): drop displays that are lost, handle events
+ * Xlib has already queued, e.g. while waiting for a reply, flush
+ * requests, and retry displays that were not ready.  Returns the poll()
+ * timeout.
+ */
+int display_dispatch(void)
+{
+	struct xdisplay *d, *next;
+
+	if (num_pending)
+		retry();
+
+	for (d = displays; d; d = next) {
+		next = d->next;
+
+		if (d->lost) {
+			syslog(LOG_NOTICE, "Lost connection to display %s", d->name);
+			display_close(d);
+			continue;
+		}
+
+		if (XQLength(d->dpy))
+			drain(d);
+		XFlush(d->dpy);
+	}
+
+	return num_pending ? DISPLAY_RETRY_MS : -1;
+}
+
+/*
+ * Subscriptions changed, update the RandR events selected everywhere
+ */
+void display_reselect(void)
+{
+	struct xdisplay *d, *cur = xd;
+
+	for (d = displays; d; d = d->next) {
+		xd = d;
+		randr_select(d->dpy);
+	}
+	xd = cur;
+}
+
+/*
+ * Local server sockets are named X<N>, for display :<N>
+ */
+static int display_name(const char *file, char *name, size_t len)
+{
+	const char *p;
+
+	if (file[0] != 'X' || !file[1])
+		return -1;
+	for (p = &file[1]; *p; p++) {
+		if (*p < '0' || *p > '9')
+			return -1;
+	}
+
+	snprintf(name, len, ":%s", &file[1]);
+
+	return 0;
+}
+
+/*
+ * Local display :<N> of @name, e.g. "unix:0.1", or -1 if remote
+ */
+static int local_name(const char *name, char *buf, size_t len)
+{
+	const char *colon;
+	char *end;
+	long num;
+
+	colon = strrchr(name, ':');
+	if (!colon || (colon != name && strncmp(name, "unix:", 5)))
+		return -1;
+
+	num = strtol(&colon[1], &end, 10);
+	if (end == &colon[1] || (*end && *end != '.'))
+		return -1;
+
+	snprintf(buf, len, ":%ld", num);
+
+	return 0;
+}
+
+/* Display to open for local server :<N>, as given with -d */
+static const char *reconnect_name(const char *local)
+{
+	for (int i = 0; i < num_reconnect; i++) {
+		if (!strcmp(reconnect[i].local, local))
+			return reconnect[i].name;
+	}
+
+	return NULL;
+}
+
+static void watch_read(int sd, void *arg)
+{
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	char *ptr;
+
+	len = read(sd, buf, sizeof(buf));
+	if (len <= 0)
+		return;
+
+	for (ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len) {
+		const struct inotify_event *ie = (const struct inotify_event *)ptr;
+		const char *open;
+		char name[64];
+
+		if (!ie->len || display_name(ie->name, name, sizeof(name)))
+			continue;
+
+		open = reconnect_name(name);
+		if (!open) {
+			if (!watch_all)
+				continue;
+			open = name;
+		}
+
+		syslog(LOG_DEBUG, "New X server socket %s, opening display %s", ie->name, open);
+		display_try(open);
+	}
+}
+
+static int watch_init(const char *dir)
+{
+	int sd;
+
+	sd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (sd == -1)
+		goto fail;
+
+	if (inotify_add_watch(sd, dir, IN_CREATE | IN_MOVED_TO) == -1) {
+		close(sd);
+		goto fail;
+	}
+	if (loop_add(sd, watch_read, NULL)) {
+		close(sd);
+		goto fail;
+	}
+	watch_sd = sd;
+
+	return 0;
+fail:
+	syslog(LOG_ERR, "Failed watching %s for new displays: %s", dir, strerror(errno));
+	return -1;
+}
+
+/*
+ * Watch @dir for X server sockets, and open all displays already there
+ */
+int display_watch(const char *dir)
+{
+	struct dirent *de;
+	DIR *dp;
+
+	if (watch_init(dir))
+		return -1;
+	watch_all = 1;
+
+	dp = opendir(dir);
+	if (!dp)
+		return 0;
+
+	while ((de = readdir(dp))) {
+		char name[64];
+
+		if (!display_name(de->d_name, name, sizeof(name)))
+			display_try(name);
+	}
+	closedir(dp);
+
+	return 0;
+}
+
+/*
+ * Reopen display @name when its server restarts, and open it as soon as
+ * it is started if not yet running.  Only works for local displays, the
+ * ones with a socket in /tmp/.X11-unix.
+ */
+int display_reconnect(const char *name)
+{
+	struct reconnect *r;
+	char local[16];
+
+	if (!name || local_name(name, local, sizeof(local))) {
+		syslog(LOG_WARNING, "Display %s is not local, cannot wait for it to restart", name ? name : "");
+		return -1;
+	}
+	if (num_reconnect >= DISPLAY_MAX_ARGS)
+		return -1;
+
+	r = &reconnect[num_reconnect++];
+	snprintf(r->name,  sizeof(r->name),  "%s", name);
+	snprintf(r->local, sizeof(r->local), "%s", local);
+
+	/* With -w the sockets are already watched */
+	if (watch_sd == -1 && watch_init(X11_UNIX_DIR))
+		return -1;
+
+	/* Its socket may already be there, the server still starting */
+	display_try(name);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
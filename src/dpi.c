@@ -0,0 +1,232 @@
+/* Screen DPI and scale, from the physical size of the outputs
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The DPI of an output is its diagonal in pixels, of the CRTC, over its
+ * physical diagonal, so rotation does not matter.  Sizes that give an
+ * unlikely DPI, e.g. projectors reporting 0 mm or the aspect ratio in
+ * cm, are ignored.  The scale is the DPI over 96, in steps of 0.25.
+ *
+ * The dpi action sets Xft.dpi in the RESOURCE_MANAGER property, what
+ * `xrdb -merge` does, to the DPI of the primary output:
+ *
+ *    display * * dpi
+ *
+ * RESOURCE_MANAGER applies to all screens, so it gets the DPI of screen
+ * 0.  Events on other screens set their screen's SCREEN_RESOURCES, like
+ * `xrdb -screen`, which clients on that screen merge on top.
+ *
+ * The property is read, and written back in one request, with the
+ * server grabbed, so no other client's changes are lost.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <X11/Xatom.h>
+#include "xplugd.h"
+
+#define DPI_DEFAULT 96
+#define DPI_MIN     50
+#define DPI_MAX     600
+#define XFT_DPI     "Xft.dpi:"
+
+/*
+ * Physical size of output @o, most exact first: preferred timing, EDID,
+ * and last the X server.  Returns -1 if unknown.
+ */
+int dpi_size(const struct xplugd_output *o, int *width, int *height)
+{
+	const struct monitor_info *edid;
+
+	*width  = o->mm_width;
+	*height = o->mm_height;
+
+	edid = randr_edid(o);
+	if (edid) {
+		const struct detailed_timing *t = NULL;
+
+		if (edid->n_detailed_timings > 0)
+			t = &edid->detailed_timings[0];
+
+		if (t && t->width_mm > 0 && t->height_mm > 0) {
+			*width  = t->width_mm;
+			*height = t->height_mm;
+		} else if (edid->width_mm > 0 && edid->height_mm > 0) {
+			*width  = edid->width_mm;
+			*height = edid->height_mm;
+		}
+	}
+
+	return *width > 0 && *height > 0 ? 0 : -1;
+}
+
+/*
+ * DPI of active output @o, and its recommended @scale, 0 if unknown
+ */
+int dpi_output(const struct xplugd_output *o, double *scale)
+{
+	double px, mm, dpi;
+	int width, height;
+
+	if (scale)
+		*scale = 1.0;
+	if (!o->crtc || !o->width || !o->height || dpi_size(o, &width, &height))
+		return 0;
+
+	px  = sqrt((double)o->width * o->width + (double)o->height * o->height);
+	mm  = sqrt((double)width * width + (double)height * height);
+	dpi = px * 25.4 / mm;
+	if (dpi < DPI_MIN || dpi > DPI_MAX)
+		return 0;
+
+	if (scale) {
+		*scale = round(dpi / DPI_DEFAULT * 4) / 4;
+		if (*scale < 1.0)
+			*scale = 1.0;
+	}
+
+	return (int)lround(dpi);
+}
+
+/*
+ * Primary output of screen @scr, or the first active one if none is
+ * set, NULL if no output is active
+ */
+const struct xplugd_output *dpi_primary(Display *dpy, int scr)
+{
+	const struct xplugd_output *first = NULL;
+	struct xplugd_output *o;
+	RROutput primary;
+	int i, num;
+
+	primary = XRRGetOutputPrimary(dpy, xd->screens[scr].root);
+	o = randr_outputs(&num);
+	for (i = 0; i < num; i++) {
+		if (o[i].screen != scr || !o[i].crtc)
+			continue;
+		if (o[i].id == primary)
+			return &o[i];
+		if (!first)
+			first = &o[i];
+	}
+
+	return first;
+}
+
+int dpi_init(Display *dpy, struct rule *r)
+{
+	return r->argc ? -1 : 0;
+}
+
+/*
+ * Set Xft.dpi in RESOURCE_MANAGER, or SCREEN_RESOURCES of screen @scr,
+ * keeping all other resources
+ */
+static int xft_dpi(Display *dpy, int scr, int dpi)
+{
+	Window root = xd->screens[scr].root;
+	unsigned long nitems = 0, bytes_after;
+	Atom prop = XA_RESOURCE_MANAGER, type;
+	unsigned char *data = NULL;
+	char *buf, *line, *next, cur[32];
+	size_t len = 0;
+	int format, rc = 0;
+
+	if (scr) {
+		if (xd->screen_res == None)
+			xd->screen_res = XInternAtom(dpy, "SCREEN_RESOURCES", False);
+		prop = xd->screen_res;
+	}
+
+	XGrabServer(dpy);
+	if (XGetWindowProperty(dpy, root, prop, 0, LONG_MAX / 4, False,
+			       XA_STRING, &type, &format, &nitems, &bytes_after, &data) != Success) {
+		errno = EIO;
+		rc = -1;
+		goto done;
+	}
+	if (type != XA_STRING || format != 8)
+		nitems = 0;
+
+	buf = arena_alloc(nitems + sizeof(cur) + 1);
+	if (!buf) {
+		rc = -1;
+		goto done;
+	}
+
+	/* Copy all lines but Xft.dpi, the property may lack a final newline */
+	snprintf(cur, sizeof(cur), "%s\t%d\n", XFT_DPI, dpi);
+	for (line = (char *)data; line && line < (char *)data + nitems; line = next) {
+		size_t n;
+
+		next = memchr(line, '\n', (char *)data + nitems - line);
+		n    = next ? (size_t)(++next - line) : (size_t)((char *)data + nitems - line);
+		if (!next)
+			next = (char *)data + nitems;
+
+		if (!strncmp(line, cur, n) && n == strlen(cur)) {
+			/* Already set, leave the property alone */
+			goto done;
+		}
+		if (n >= strlen(XFT_DPI) && !strncmp(line, XFT_DPI, strlen(XFT_DPI)))
+			continue;
+
+		memcpy(&buf[len], line, n);
+		len += n;
+		if (buf[len - 1] != '\n')
+			buf[len++] = '\n';
+	}
+	memcpy(&buf[len], cur, strlen(cur));
+	len += strlen(cur);
+
+	syslog(LOG_INFO, "Setting Xft.dpi %d on %s screen %d", dpi, xd->name, scr);
+	XChangeProperty(dpy, root, prop, XA_STRING, 8, PropModeReplace,
+			(unsigned char *)buf, len);
+done:
+	XUngrabServer(dpy);
+	XFlush(dpy);
+	if (data)
+		XFree(data);
+
+	return rc;
+}
+
+int dpi_run(Display *dpy, struct rule *r, struct event *ev)
+{
+	const struct xplugd_output *o;
+	int dpi = 0;
+
+	o = dpi_primary(dpy, ev->screen);
+	if (o)
+		dpi = dpi_output(o, NULL);
+	if (!dpi)
+		dpi = DPI_DEFAULT;
+
+	return xft_dpi(dpy, ev->screen, dpi);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
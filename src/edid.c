@@ -522,6 +522,59 @@ error:
 	return NULL;
 }
 
+/*
+ * Check that the base block has a valid header and checksum.
+ */
+int edid_valid(const unsigned char *edid, size_t len)
+{
+	unsigned char check = 0;
+
+	if (!edid || len < EDID_BLOCK_LEN)
+		return 0;
+
+	if (!is_edid_header(edid))
+		return 0;
+
+	for (int i = 0; i < EDID_BLOCK_LEN; ++i)
+		check += edid[i];
+
+	return check == 0;
+}
+
+/*
+ * Length of the EDID, base block plus extension blocks, clamped to the
+ * available data.  Returns 0 if there is no EDID header at @edid.
+ */
+size_t edid_length(const unsigned char *edid, size_t len)
+{
+	size_t need;
+
+	if (!edid || len < EDID_BLOCK_LEN || !is_edid_header(edid))
+		return 0;
+
+	need = EDID_BLOCK_LEN * (1 + (size_t)edid[0x7e]);
+	if (need > len)
+		need = len - len % EDID_BLOCK_LEN;
+
+	return need;
+}
+
+/*
+ * 64-bit FNV-1a hash of the raw EDID blob, used to identify monitors
+ * and to cache decoded data.
+ */
+uint64_t edid_hash(const unsigned char *edid, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= edid[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -22,6 +22,14 @@
 
 /* Author: Soren Sandmann <sandmann@redhat.com> */
 
+#ifndef EDID_H_
+#define EDID_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EDID_BLOCK_LEN 128
+
 enum interface {
 	UNDEFINED,
 	DVI,
@@ -168,6 +176,12 @@ struct monitor_info {
 
 struct monitor_info *edid_decode(const unsigned char *data);
 
+int      edid_valid  (const unsigned char *data, size_t len);
+size_t   edid_length (const unsigned char *data, size_t len);
+uint64_t edid_hash   (const unsigned char *data, size_t len);
+
+#endif /* EDID_H_ */
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -0,0 +1,102 @@
+/* Example xplugd plugin, logs all events and keeps a count
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Load with the following line in xplugd.conf, add "quiet" to only
+ * count events:
+ *
+ *    plugin /path/to/example.so [quiet]
+ */
+
+#include <string.h>
+#include <syslog.h>
+#include "plugin.h"
+
+static const struct xplugd_api *xplugd;
+static unsigned long count;
+static int quiet;
+
+static int init(const struct xplugd_api *api, int argc, char *argv[])
+{
+	xplugd = api;
+	quiet  = argc > 1 && !strcmp(argv[1], "quiet");
+
+	return 0;
+}
+
+static void fini(void)
+{
+	syslog(LOG_INFO, "example: handled %lu events", count);
+}
+
+static int on_input(const struct xplugd_event *ev, const struct xplugd_device *dev)
+{
+	count++;
+	if (quiet)
+		return 0;
+
+	syslog(LOG_INFO, "example: %s %s %s %s", ev->type, ev->device, ev->status,
+	       dev ? dev->name : "");
+
+	return 0;
+}
+
+static int on_display(const struct xplugd_event *ev, const struct xplugd_output *out,
+		      const struct monitor_info *edid)
+{
+	const struct xplugd_output *outputs;
+	int i, num, active = 0;
+
+	count++;
+	if (quiet)
+		return 0;
+
+	/* The daemon's topology is available without any X round trips */
+	outputs = xplugd->outputs(&num);
+	for (i = 0; i < num; i++) {
+		if (outputs[i].crtc)
+			active++;
+	}
+
+	syslog(LOG_INFO, "example: %s %s %s, %d active outputs", ev->type, ev->device, ev->status, active);
+	if (edid)
+		syslog(LOG_INFO, "example: %s %s, %dx%d mm, made %d", edid->manufacturer_code,
+		       edid->dsc_product_name, edid->width_mm, edid->height_mm, edid->production_year);
+
+	return 0;
+}
+
+const struct xplugd_plugin xplugd_plugin = {
+	.abi        = XPLUGD_PLUGIN_ABI,
+	.name       = "example",
+	.init       = init,
+	.exit       = fini,
+	.on_input   = on_input,
+	.on_display = on_display,
+};
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
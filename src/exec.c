@@ -20,9 +20,24 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdarg.h>
 #include "xplugd.h"
 
-static Display *display = NULL;
+extern char **environ;
+
+/*
+ * The script's environment: the daemon's own, followed by DISPLAY and
+ * XPLUG_* variables for the current event.  The array is allocated
+ * once, only the tail is rewritten for each event, with strings from
+ * the event's arena.
+ */
+static char **envp;
+static int    envn;			/* Inherited variables */
+static int    envc;
+
+static const char *use_names[] = {
+	"", "master-pointer", "master-keyboard", "slave-pointer", "slave-keyboard", "floating"
+};
 
 static void catch_child(int sig)
 {
@@ -33,44 +48,231 @@ static void catch_child(int sig)
 		syslog(LOG_DEBUG, "Collected PID %d", pid);
 }
 
-int exec_init(Display *dpy)
+static void env_add(const char *name, const char *fmt, ...)
+{
+	size_t len = strlen(name) + 1;
+	va_list ap;
+	char *var;
+	int n;
+
+	if (!envp || envc >= envn + ENV_MAX)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+
+	var = arena_alloc(len + n + 1);
+	if (!var) {
+		syslog(LOG_DEBUG, "No room for %s in environment", name);
+		return;
+	}
+
+	snprintf(var, len + 1, "%s=", name);
+	va_start(ap, fmt);
+	vsnprintf(&var[len], n + 1, fmt, ap);
+	va_end(ap);
+
+	envp[envc++] = var;
+}
+
+/*
+ * DPI and scale of the output, and of the primary output of its screen
+ */
+static void env_dpi(const struct xplugd_output *o)
+{
+	const struct xplugd_output *primary;
+	double scale;
+	int dpi;
+
+	dpi = dpi_output(o, &scale);
+	if (dpi) {
+		env_add("XPLUG_DPI",   "%d", dpi);
+		env_add("XPLUG_SCALE", "%.2f", scale);
+	}
+
+	primary = dpi_primary(xd->dpy, o->screen);
+	if (!primary)
+		return;
+
+	dpi = dpi_output(primary, &scale);
+	if (dpi) {
+		env_add("XPLUG_PRIMARY",       "%s", primary->name);
+		env_add("XPLUG_PRIMARY_DPI",   "%d", dpi);
+		env_add("XPLUG_PRIMARY_SCALE", "%.2f", scale);
+	}
+}
+
+static void env_display(const struct xplugd_output *o)
+{
+	const struct detailed_timing *t = NULL;
+	const struct monitor_info *edid;
+	int width, height;
+
+	if (o->crtc)
+		env_add("XPLUG_CRTC", "%ux%u+%d+%d", o->width, o->height, o->x, o->y);
+	env_dpi(o);
+	if (!o->edid_hash)
+		return;
+
+	env_add("XPLUG_EDID_HASH", "%016" PRIx64, o->edid_hash);
+	env_add("XPLUG_VENDOR",    "%s", o->vendor);
+	env_add("XPLUG_PRODUCT",   "%04x", o->product);
+	env_add("XPLUG_SERIAL",    "%u", o->serial);
+	env_add("XPLUG_MODEL",     "%s", o->model);
+
+	edid = randr_edid(o);
+	if (edid) {
+		if (edid->n_detailed_timings > 0)
+			t = &edid->detailed_timings[0];
+
+		if (edid->dsc_serial_number[0])
+			env_add("XPLUG_SERIAL_STRING", "%s", edid->dsc_serial_number);
+		if (edid->production_year > 0)
+			env_add("XPLUG_YEAR", "%d", edid->production_year);
+	}
+	if (!dpi_size(o, &width, &height)) {
+		env_add("XPLUG_WIDTH_MM",  "%d", width);
+		env_add("XPLUG_HEIGHT_MM", "%d", height);
+	}
+
+	if (t) {
+		double total = (double)(t->h_addr + t->h_blank) * (t->v_addr + t->v_blank);
+
+		env_add("XPLUG_PREFERRED", "%dx%d@%.2f", t->h_addr, t->v_addr,
+			total > 0 ? t->pixel_clock / total : 0.0);
+	}
+}
+
+/*
+ * Rewrite the XPLUG_* part of the script's environment for @ev
+ */
+static void env_build(struct event *ev)
+{
+	char display[80];
+
+	if (!envp)
+		return;
+
+	envc = envn;
+
+	/* Clients started by the script should use the screen of the event */
+	if (display_screen(xd, ev->screen, display, sizeof(display)))
+		snprintf(display, sizeof(display), "%s", xd->name);
+
+	env_add("DISPLAY",       "%s", display);
+	env_add("XPLUG_DISPLAY", "%s", xd->name);
+	env_add("XPLUG_SCREEN",  "%d", ev->screen);
+	env_add("XPLUG_TYPE",    "%s", ev->type);
+	env_add("XPLUG_DEVICE",  "%s", ev->device);
+	env_add("XPLUG_STATUS",  "%s", ev->status);
+	env_add("XPLUG_NAME",    "%s", ev->name ? ev->name : "");
+
+	if (ev->output) {
+		env_display(ev->output);
+	} else if (ev->input) {
+		const struct xplugd_device *dev = input_device(atoi(ev->device));
+
+		if (dev) {
+			char caps[128];
+
+			if (dev->use > 0 && dev->use < (int)(sizeof(use_names) / sizeof(use_names[0])))
+				env_add("XPLUG_USE", "%s", use_names[dev->use]);
+			env_add("XPLUG_ENABLED", "%d", dev->enabled);
+			if (dev->vendor_id)
+				env_add("XPLUG_USB_ID", "%04x:%04x", dev->vendor_id, dev->product_id);
+			if (dev->node[0])
+				env_add("XPLUG_NODE", "%s", dev->node);
+			if (dev->caps)
+				env_add("XPLUG_CAPS", "%s", input_caps(dev->caps, caps, sizeof(caps)));
+		}
+	}
+
+	envp[envc] = NULL;
+}
+
+int exec_init(void)
 {
 	struct sigaction sa = {
 		.sa_flags = SA_RESTART,
 		.sa_handler = catch_child,
 	};
+	int i, num = 0;
 
-	display = dpy;
 	sigaction(SIGCHLD, &sa, NULL);
 
+	for (i = 0; environ && environ[i]; i++)
+		num++;
+
+	/* Falls back to plain execv() if this fails */
+	envp = calloc(num + ENV_MAX + 1, sizeof(char *));
+	if (!envp) {
+		syslog(LOG_WARNING, "Failed allocating script environment: %s", strerror(errno));
+		return 0;
+	}
+
+	/*
+	 * Stale XPLUG_* from our own parent would mix with the new ones,
+	 * and DISPLAY is set to the display of each event
+	 */
+	for (i = 0; i < num; i++) {
+		if (strncmp(environ[i], "XPLUG_", 6) && strncmp(environ[i], "DISPLAY=", 8))
+			envp[envn++] = environ[i];
+	}
+
 	return 0;
 }
 
-int exec(char *type, char *device, char *status, char *name)
+/*
+ * Called in a forked child, exec @path with the arguments of @ev and
+ * the environment built for it, see env_build()
+ */
+void exec_child(const char *path, struct event *ev)
 {
-	pid_t pid;
+	char screen[12];
+	char *args[] = {
+		(char *)path,
+		ev->type,
+		ev->device,
+		ev->status,
+		ev->name ? ev->name : "",
+		screen,
+		NULL
+	};
 
-	syslog(LOG_DEBUG, "Calling %s %s %s %s %s", cmd, type, device, status, name ? name : "");
+	snprintf(screen, sizeof(screen), "%d", ev->screen);
 
-	pid = fork();
-	if (!pid) {
-		char *args[] = {
-			cmd,
-			type,
-			device,
-			status,
-			name ? name : "",
-			NULL
-		};
-
-		setsid();
-		if (display)
-			close(ConnectionNumber(display));
+	/* X connections are close-on-exec */
+	setsid();
 
+	if (envp)
+		execve(args[0], args, envp);
+	else
 		execv(args[0], args);
-		syslog(LOG_ERR, "Failed calling %s: %s", cmd, strerror(errno));
-		exit(0);
-	}
+	syslog(LOG_ERR, "Failed calling %s: %s", path, strerror(errno));
+	_exit(0);
+}
+
+/*
+ * Call the script, and the hooks of the event, see hook.c
+ */
+int exec(struct event *ev)
+{
+	pid_t pid;
+
+	env_build(ev);
+	hook_run(ev);
+	if (!cmd)
+		return 0;
+
+	syslog(LOG_DEBUG, "Calling %s %s %s %s %s %d", cmd, ev->type, ev->device, ev->status,
+	       ev->name ? ev->name : "", ev->screen);
+
+	pid = fork();
+	if (!pid)
+		exec_child(cmd, ev);
 
 	syslog(LOG_DEBUG, "Started %s as PID %d", cmd, pid);
 
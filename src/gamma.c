@@ -0,0 +1,392 @@
+/* Per-monitor gamma ramps, from a calibration file or the EDID
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The gamma action loads the gamma ramp of the CRTC of an output, like
+ * `dispwin` or `xcalib`.  The ramp is read from an ArgyllCMS .cal file
+ * named after the EDID hash of the monitor, see `xplugd -p`:
+ *
+ *    ~/.config/xplugd.gamma/0123456789abcdef.cal
+ *
+ * Monitors without a calibration get a ramp from the gamma in their
+ * EDID, correcting it to TARGET, default 2.2.  With d65 the channels
+ * are also scaled to move the EDID white point to D65, using the EDID
+ * primaries.  A monitor without EDID gamma gets a linear ramp, which
+ * resets what the previous monitor on the CRTC had:
+ *
+ *    display connected * gamma
+ *    crtc    enabled   * gamma 2.4 d65
+ *
+ * Ramps are cached per monitor, settings, and ramp size, and the ramp
+ * size per CRTC, so a monitor seen before costs one request.
+ */
+
+#include <math.h>
+#include <inttypes.h>
+#include "xplugd.h"
+
+#define GAMMA_TARGET  2.2
+#define GAMMA_CAL_MAX 4096		/* Entries in a .cal file */
+
+#define D65_X         0.3127
+#define D65_Y         0.3290
+
+/* Rule arguments, prepared when the rule is read */
+struct gamma {
+	double        target;
+	int           d65;
+};
+
+static struct {
+	uint64_t      hash;
+	int           size;
+	struct gamma  g;
+	XRRCrtcGamma *ramp;
+} cache[EDID_CACHE_SIZE];
+static int cache_next;
+
+int gamma_init(Display *dpy, struct rule *r)
+{
+	struct gamma *g;
+	int i;
+
+	g = calloc(1, sizeof(*g));
+	if (!g)
+		return -1;
+
+	g->target = GAMMA_TARGET;
+	for (i = 0; i < r->argc; i++) {
+		char *end;
+
+		if (!strcmp(r->argv[i], "d65")) {
+			g->d65 = 1;
+			continue;
+		}
+
+		g->target = strtod(r->argv[i], &end);
+		if (*end || g->target < 1.0 || g->target > 3.0) {
+			free(g);
+			return -1;
+		}
+	}
+	r->priv = g;
+
+	return 0;
+}
+
+void gamma_exit(struct rule *r)
+{
+	int i;
+
+	free(r->priv);
+
+	/* Reread calibrations on reload */
+	for (i = 0; i < EDID_CACHE_SIZE; i++) {
+		if (cache[i].ramp)
+			XRRFreeGamma(cache[i].ramp);
+		cache[i].ramp = NULL;
+	}
+	cache_next = 0;
+}
+
+/*
+ * Read the RGB_I RGB_R RGB_G RGB_B table of an ArgyllCMS .cal file and
+ * resample it to @ramp.  Returns -1 if there is no such file.
+ */
+static int gamma_cal(uint64_t hash, XRRCrtcGamma *ramp)
+{
+	char name[64], line[256], *file;
+	float *cal = NULL;
+	int i, num = 0, data = 0;
+	FILE *fp;
+
+	snprintf(name, sizeof(name), "%s/%016" PRIx64 ".cal", GAMMA_DIR, hash);
+	file = config_file(name);
+	if (!file)
+		return -1;
+
+	fp = fopen(file, "r");
+	if (!fp) {
+		free(file);
+		return -1;
+	}
+
+	cal = arena_alloc(GAMMA_CAL_MAX * 3 * sizeof(float));
+	if (!cal)
+		goto fail;
+
+	while (fgets(line, sizeof(line), fp)) {
+		float in, r, g, b;
+
+		if (!strncmp(line, "BEGIN_DATA", 10) && strncmp(line, "BEGIN_DATA_FORMAT", 17)) {
+			data = 1;
+			continue;
+		}
+		if (!strncmp(line, "END_DATA", 8) && strncmp(line, "END_DATA_FORMAT", 15))
+			break;
+		if (!data || sscanf(line, "%f %f %f %f", &in, &r, &g, &b) != 4)
+			continue;
+		if (num == GAMMA_CAL_MAX)
+			break;
+
+		cal[num * 3]     = r;
+		cal[num * 3 + 1] = g;
+		cal[num * 3 + 2] = b;
+		num++;
+	}
+
+	if (num < 2) {
+		syslog(LOG_WARNING, "No calibration data in %s", file);
+		goto fail;
+	}
+
+	for (i = 0; i < ramp->size; i++) {
+		double pos = (double)i * (num - 1) / (ramp->size - 1), frac, v[3];
+		int j = (int)pos, c;
+
+		if (j >= num - 1)
+			j = num - 2;
+		frac = pos - j;
+		for (c = 0; c < 3; c++) {
+			v[c] = cal[j * 3 + c] + (cal[(j + 1) * 3 + c] - cal[j * 3 + c]) * frac;
+			v[c] = v[c] < 0 ? 0 : v[c] > 1 ? 1 : v[c];
+		}
+
+		ramp->red[i]   = (unsigned short)lround(v[0] * 65535);
+		ramp->green[i] = (unsigned short)lround(v[1] * 65535);
+		ramp->blue[i]  = (unsigned short)lround(v[2] * 65535);
+	}
+
+	syslog(LOG_DEBUG, "Loaded %d entry calibration %s", num, file);
+	fclose(fp);
+	free(file);
+
+	return 0;
+fail:
+	fclose(fp);
+	free(file);
+
+	return -1;
+}
+
+/* XYZ of chromaticity x,y with Y = 1 */
+static int xyz(double x, double y, double v[3])
+{
+	if (y <= 0.0)
+		return -1;
+
+	v[0] = x / y;
+	v[1] = 1.0;
+	v[2] = (1.0 - x - y) / y;
+
+	return 0;
+}
+
+/* Solve m * out = v, columns of m are the primaries */
+static int solve(double m[3][3], const double v[3], double out[3])
+{
+	double det;
+
+	det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+	    - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+	    + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	if (fabs(det) < 1e-9)
+		return -1;
+
+	for (int c = 0; c < 3; c++) {
+		double t[3][3];
+
+		memcpy(t, m, sizeof(t));
+		for (int r = 0; r < 3; r++)
+			t[r][c] = v[r];
+
+		out[c] = (t[0][0] * (t[1][1] * t[2][2] - t[1][2] * t[2][1])
+			- t[0][1] * (t[1][0] * t[2][2] - t[1][2] * t[2][0])
+			+ t[0][2] * (t[1][0] * t[2][1] - t[1][1] * t[2][0])) / det;
+	}
+
+	return 0;
+}
+
+/*
+ * Channel gains that move the white point of the monitor to D65.  The
+ * monitor's white is RGB 1,1,1, so the gains are D65 in the monitor's
+ * RGB, divided by its white, and scaled to a maximum of 1.  Returns -1
+ * for chromaticities that make no sense.
+ */
+static int gamma_white(const struct monitor_info *edid, double gain[3])
+{
+	double m[3][3], p[3][3], w[3], d65[3], s[3], max = 0;
+	int c;
+
+	if (xyz(edid->red_x, edid->red_y, p[0]) || xyz(edid->green_x, edid->green_y, p[1]) ||
+	    xyz(edid->blue_x, edid->blue_y, p[2]) || xyz(edid->white_x, edid->white_y, w))
+		return -1;
+	xyz(D65_X, D65_Y, d65);
+
+	for (c = 0; c < 3; c++) {
+		for (int r = 0; r < 3; r++)
+			m[r][c] = p[c][r];
+	}
+
+	if (solve(m, w, s))
+		return -1;
+	if (solve(m, d65, gain))
+		return -1;
+
+	for (c = 0; c < 3; c++) {
+		if (s[c] <= 0.0)
+			return -1;
+		gain[c] /= s[c];
+		if (gain[c] > max)
+			max = gain[c];
+	}
+	for (c = 0; c < 3; c++) {
+		gain[c] /= max;
+		if (gain[c] < 0.5)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Ramp from the EDID gamma, the monitor shows v^edid, so v = x^(target/edid)
+ * gives x^target.  The D65 gains are for linear light, so each channel
+ * is scaled by gain^(1/edid) in the ramp, which the monitor shows as gain.
+ */
+static void gamma_edid(const struct monitor_info *edid, const struct gamma *g, XRRCrtcGamma *ramp)
+{
+	double gain[3] = { 1.0, 1.0, 1.0 }, white[3], power = 1.0, display = GAMMA_TARGET;
+	int i, c;
+
+	if (edid && edid->gamma > 0) {
+		display = edid->gamma;
+		power   = g->target / display;
+	}
+	if (edid && g->d65) {
+		if (gamma_white(edid, white)) {
+			syslog(LOG_DEBUG, "Invalid EDID chromaticity, not correcting white point");
+		} else {
+			for (c = 0; c < 3; c++)
+				gain[c] = pow(white[c], 1.0 / display);
+		}
+	}
+
+	for (i = 0; i < ramp->size; i++) {
+		double v = pow((double)i / (ramp->size - 1), power);
+
+		ramp->red[i]   = (unsigned short)lround(v * gain[0] * 65535);
+		ramp->green[i] = (unsigned short)lround(v * gain[1] * 65535);
+		ramp->blue[i]  = (unsigned short)lround(v * gain[2] * 65535);
+	}
+}
+
+static XRRCrtcGamma *gamma_ramp(const struct xplugd_output *o, const struct gamma *g, int size)
+{
+	XRRCrtcGamma *ramp;
+	int i;
+
+	for (i = 0; i < EDID_CACHE_SIZE; i++) {
+		if (cache[i].ramp && cache[i].hash == o->edid_hash && cache[i].size == size &&
+		    cache[i].g.target == g->target && cache[i].g.d65 == g->d65)
+			return cache[i].ramp;
+	}
+
+	ramp = XRRAllocGamma(size);
+	if (!ramp)
+		return NULL;
+
+	if (!o->edid_hash || gamma_cal(o->edid_hash, ramp))
+		gamma_edid(randr_edid(o), g, ramp);
+
+	if (cache[cache_next].ramp)
+		XRRFreeGamma(cache[cache_next].ramp);
+	cache[cache_next].hash = o->edid_hash;
+	cache[cache_next].size = size;
+	cache[cache_next].g    = *g;
+	cache[cache_next].ramp = ramp;
+	cache_next = (cache_next + 1) % EDID_CACHE_SIZE;
+
+	return ramp;
+}
+
+/* Ramp size of @crtc, asked once per server */
+static int gamma_size(Display *dpy, RRCrtc crtc)
+{
+	int i, size;
+
+	for (i = 0; i < xd->num_gamma; i++) {
+		if (xd->gamma_crtc[i] == crtc)
+			return xd->gamma_size[i];
+	}
+
+	size = XRRGetCrtcGammaSize(dpy, crtc);
+	if (size > 1 && xd->num_gamma < MAX_OUTPUTS) {
+		xd->gamma_crtc[xd->num_gamma] = crtc;
+		xd->gamma_size[xd->num_gamma] = size;
+		xd->num_gamma++;
+	}
+
+	return size;
+}
+
+int gamma_run(Display *dpy, struct rule *r, struct event *ev)
+{
+	const struct xplugd_output *o = ev->output;
+	XRRCrtcGamma *ramp;
+	int size;
+
+	if (ev->input || !o) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Not lit yet, the crtc enabled event follows */
+	if (!o->crtc) {
+		syslog(LOG_DEBUG, "Output %s has no CRTC, no gamma ramp", o->name);
+		return 0;
+	}
+
+	size = gamma_size(dpy, o->crtc);
+	if (size < 2) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	ramp = gamma_ramp(o, r->priv, size);
+	if (!ramp)
+		return -1;
+
+	syslog(LOG_DEBUG, "Setting %d entry gamma ramp on %s", size, o->name);
+	XRRSetCrtcGamma(dpy, o->crtc, ramp);
+	XFlush(dpy);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
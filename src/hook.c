@@ -0,0 +1,427 @@
+/* Hook directory, scripts run in parallel in dependency order
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Executables in ~/.config/xplugrc.d/ are called like the script, with
+ * the same arguments and environment.  A comment in the first lines of
+ * a hook declares the events it handles, TYPE or TYPE:STATUS globs, and
+ * the hooks it must run after:
+ *
+ *    #!/bin/sh
+ *    # xplug-events: display crtc:enabled
+ *    # xplug-after:  10-layout
+ *
+ * Hooks without xplug-events get all events, hooks that do not match
+ * an event are not started at all.  Ordering only applies between the
+ * hooks of the same event, a hook is started when the hooks it is to
+ * run after have exited, successfully or not.
+ *
+ * The daemon forks one runner per event, which starts all hooks that
+ * are ready, waits for any of them, and starts the ones waiting for it,
+ * so an event takes as long as its longest chain of hooks.
+ *
+ * The directory is read again when its modification time changes, i.e.
+ * when hooks are added, removed, or renamed, or when a hook is edited
+ * in place, changing its own modification time.
+ */
+
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "xplugd.h"
+
+#define HOOK_PREFIX "xplug-"
+
+struct hook_event {
+	char          type[16];
+	char          status[16];	/* Empty: any */
+};
+
+struct hook {
+	char          path[PATH_MAX];
+	const char   *name;		/* Points into path */
+	struct hook_event events[HOOK_EVENTS];
+	int           num_events;	/* 0: all events */
+	uint32_t      after;		/* Bitmask of hooks */
+	struct timespec mtime;
+};
+
+static struct hook hooks[HOOK_MAX];
+static int num_hooks;
+
+static char *hookdir;
+static struct timespec hookdir_mtime;
+
+static int hook_find(const char *name)
+{
+	for (int i = 0; i < num_hooks; i++) {
+		if (!strcmp(hooks[i].name, name))
+			return i;
+	}
+
+	return -1;
+}
+
+static void hook_events(struct hook *h, char *list)
+{
+	char *tok;
+
+	for (tok = strtok(list, " \t,\n"); tok; tok = strtok(NULL, " \t,\n")) {
+		struct hook_event *e;
+		char *status;
+
+		if (h->num_events >= HOOK_EVENTS) {
+			syslog(LOG_WARNING, "Hook %s: too many events, max %d", h->name, HOOK_EVENTS);
+			break;
+		}
+
+		e = &h->events[h->num_events++];
+		status = strchr(tok, ':');
+		if (status)
+			*status++ = 0;
+		snprintf(e->type, sizeof(e->type), "%s", tok);
+		snprintf(e->status, sizeof(e->status), "%s", status ? status : "");
+	}
+}
+
+static void hook_after(struct hook *h, char *list)
+{
+	char *tok;
+
+	for (tok = strtok(list, " \t,\n"); tok; tok = strtok(NULL, " \t,\n")) {
+		int i = hook_find(tok);
+
+		if (i < 0) {
+			syslog(LOG_WARNING, "Hook %s: no such hook %s, ignoring", h->name, tok);
+			continue;
+		}
+		h->after |= 1u << i;
+	}
+}
+
+/*
+ * Read the xplug-events: and xplug-after: lines of hook @h
+ */
+static void hook_parse(struct hook *h)
+{
+	char line[256];
+	FILE *fp;
+	int n;
+
+	fp = fopen(h->path, "r");
+	if (!fp)
+		return;
+
+	for (n = 0; n < HOOK_HEADER_LINES && fgets(line, sizeof(line), fp); n++) {
+		char *p = line;
+
+		if (*p++ != '#')
+			continue;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (strncmp(p, HOOK_PREFIX, strlen(HOOK_PREFIX)))
+			continue;
+
+		p += strlen(HOOK_PREFIX);
+		if (!strncmp(p, "events:", 7))
+			hook_events(h, p + 7);
+		else if (!strncmp(p, "after:", 6))
+			hook_after(h, p + 6);
+	}
+
+	fclose(fp);
+}
+
+/*
+ * Hooks in a dependency loop would never run.  A hook is in a loop if
+ * it can reach itself through xplug-after, the loop is every hook it
+ * reaches that also reaches it.  Drop only the ordering within loops,
+ * hooks before or after a loop keep theirs.
+ */
+static void hook_loops(void)
+{
+	uint32_t reach[HOOK_MAX];
+	int i, j;
+
+	for (i = 0; i < num_hooks; i++)
+		reach[i] = hooks[i].after;
+
+	/* Transitive closure, one bit per hook */
+	for (j = 0; j < num_hooks; j++) {
+		for (i = 0; i < num_hooks; i++) {
+			if (reach[i] & (1u << j))
+				reach[i] |= reach[j];
+		}
+	}
+
+	for (i = 0; i < num_hooks; i++) {
+		uint32_t loop = 0;
+
+		if (!(reach[i] & (1u << i)))
+			continue;
+
+		for (j = 0; j < num_hooks; j++) {
+			if ((reach[i] & (1u << j)) && (reach[j] & (1u << i)))
+				loop |= 1u << j;
+		}
+
+		syslog(LOG_WARNING, "Hook %s is in a dependency loop, ignoring its order in the loop",
+		       hooks[i].name);
+		hooks[i].after &= ~loop;
+	}
+}
+
+static void hook_scan(void)
+{
+	struct dirent **list;
+	int i, num;
+
+	num_hooks = 0;
+	num = scandir(hookdir, &list, NULL, alphasort);
+	if (num < 0)
+		return;
+
+	/* All names first, xplug-after may refer to any hook */
+	for (i = 0; i < num; i++) {
+		const char *name = list[i]->d_name;
+		char path[PATH_MAX];
+		struct hook *h;
+		struct stat st;
+		int len;
+
+		if (name[0] == '.' || name[strlen(name) - 1] == '~')
+			goto next;
+
+		len = snprintf(path, sizeof(path), "%s/%s", hookdir, name);
+		if (len < 0 || (size_t)len >= sizeof(path))
+			goto next;
+		if (stat(path, &st) || !S_ISREG(st.st_mode) || access(path, X_OK))
+			goto next;
+
+		if (num_hooks >= HOOK_MAX) {
+			syslog(LOG_WARNING, "Too many hooks in %s, max %d, skipping %s", hookdir, HOOK_MAX, name);
+			goto next;
+		}
+
+		h = &hooks[num_hooks++];
+		memcpy(h->path, path, len + 1);
+		h->name       = &h->path[len - strlen(name)];
+		h->num_events = 0;
+		h->after      = 0;
+		h->mtime      = st.st_mtim;
+	next:
+		free(list[i]);
+	}
+	free(list);
+
+	for (i = 0; i < num_hooks; i++)
+		hook_parse(&hooks[i]);
+	hook_loops();
+
+	syslog(LOG_DEBUG, "Found %d hooks in %s", num_hooks, hookdir);
+}
+
+static int mtime_eq(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+/*
+ * Read the hook directory again if it, or any hook in it, has changed
+ */
+static void hook_check(void)
+{
+	struct stat st;
+	int i;
+
+	if (stat(hookdir, &st)) {
+		num_hooks = 0;
+		memset(&hookdir_mtime, 0, sizeof(hookdir_mtime));
+		return;
+	}
+
+	if (!mtime_eq(&st.st_mtim, &hookdir_mtime)) {
+		hookdir_mtime = st.st_mtim;
+		hook_scan();
+		return;
+	}
+
+	/* Edited in place, the directory is unchanged */
+	for (i = 0; i < num_hooks; i++) {
+		if (stat(hooks[i].path, &st) || !mtime_eq(&st.st_mtim, &hooks[i].mtime)) {
+			hook_scan();
+			return;
+		}
+	}
+}
+
+static int hook_match(const struct hook *h, const struct event *ev)
+{
+	if (!h->num_events)
+		return 1;
+
+	for (int i = 0; i < h->num_events; i++) {
+		const struct hook_event *e = &h->events[i];
+
+		if (fnmatch(e->type, ev->type, 0))
+			continue;
+		if (e->status[0] && fnmatch(e->status, ev->status, 0))
+			continue;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static long msec_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/*
+ * Forked once per event, starts the @match hooks in order and waits
+ * for them.  The last hook left is exec'ed instead, saving a fork.
+ */
+static void hook_runner(uint32_t match, struct event *ev)
+{
+	pid_t pids[HOOK_MAX] = { 0 };
+	uint32_t started = 0, done = 0;
+	struct timespec start;
+	int i;
+
+	/* The daemon's handler would reap our hooks */
+	signal(SIGCHLD, SIG_DFL);
+	setsid();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (done != match) {
+		int status;
+		pid_t pid;
+
+		for (i = 0; i < num_hooks; i++) {
+			uint32_t bit = 1u << i;
+
+			if (!(match & bit) || (started & bit) || (hooks[i].after & match & ~done))
+				continue;
+
+			started |= bit;
+			if (started == match && done == (match & ~bit))
+				exec_child(hooks[i].path, ev);
+
+			pids[i] = fork();
+			if (!pids[i])
+				exec_child(hooks[i].path, ev);
+			if (pids[i] < 0) {
+				syslog(LOG_ERR, "Failed starting hook %s: %s", hooks[i].name, strerror(errno));
+				done |= bit;
+			}
+		}
+
+		/* Failed fork, nothing running, look for more that are ready */
+		if (!(started & ~done))
+			continue;
+
+		pid = wait(&status);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < num_hooks; i++) {
+			if (pids[i] != pid)
+				continue;
+
+			if (!WIFEXITED(status) || WEXITSTATUS(status))
+				syslog(LOG_DEBUG, "Hook %s failed, status %d", hooks[i].name, status);
+			done |= 1u << i;
+			break;
+		}
+	}
+
+	syslog(LOG_DEBUG, "Hooks for %s %s %s done in %ld msec", ev->type, ev->device, ev->status,
+	       msec_since(&start));
+	_exit(0);
+}
+
+/*
+ * Start the hooks matching @ev, the environment is already built for it
+ */
+void hook_run(struct event *ev)
+{
+	uint32_t match = 0;
+	pid_t pid;
+	int i;
+
+	if (!hookdir)
+		return;
+
+	hook_check();
+	for (i = 0; i < num_hooks; i++) {
+		if (hook_match(&hooks[i], ev))
+			match |= 1u << i;
+	}
+	if (!match)
+		return;
+
+	pid = fork();
+	if (!pid)
+		hook_runner(match, ev);
+	if (pid < 0) {
+		syslog(LOG_ERR, "Failed starting hooks for %s %s: %s", ev->type, ev->device, strerror(errno));
+		return;
+	}
+
+	syslog(LOG_DEBUG, "Started hooks for %s %s %s as PID %d", ev->type, ev->device, ev->status, pid);
+}
+
+/*
+ * Returns -1 if there is no hook directory
+ */
+int hook_init(void)
+{
+	struct stat st;
+
+	hookdir = config_file(HOOK_DIR);
+	if (!hookdir)
+		return -1;
+
+	/* Read on the first event */
+	if (stat(hookdir, &st) || !S_ISDIR(st.st_mode))
+		return -1;
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -20,6 +20,7 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <X11/Xatom.h>
 #include "xplugd.h"
 
 #define T(x) {x, #x}
@@ -35,8 +36,8 @@ struct pair {
 };
 
 const struct pair device_types[] = {
-	T(XIMasterPointer),
-	T(XIMasterKeyboard),
+	{XIMasterPointer, "master-pointer"},
+	{XIMasterKeyboard, "master-keyboard"},
 	{XISlavePointer, "pointer"},
 	{XISlaveKeyboard, "keyboard"},
 	T(XIFloatingSlave),
@@ -44,8 +45,8 @@ const struct pair device_types[] = {
 };
 
 const struct pair changes[] = {
-	T(XIMasterAdded),
-	T(XIMasterRemoved),
+	{XIMasterAdded, "added"},
+	{XIMasterRemoved, "removed"},
 	T(XISlaveAdded),
 	T(XISlaveRemoved),
 	T(XISlaveAttached),
@@ -55,7 +56,17 @@ const struct pair changes[] = {
 	T_END
 };
 
-static int xi_opcode = -1;
+static const struct pair caps[] = {
+	{XPLUGD_CAP_KEYS,        "keys"},
+	{XPLUGD_CAP_BUTTONS,     "buttons"},
+	{XPLUGD_CAP_RELATIVE,    "relative"},
+	{XPLUGD_CAP_ABSOLUTE,    "absolute"},
+	{XPLUGD_CAP_SCROLL,      "scroll"},
+	{XPLUGD_CAP_TOUCHSCREEN, "touchscreen"},
+	{XPLUGD_CAP_TOUCHPAD,    "touchpad"},
+	T_END
+};
+
 
 static const struct pair *map(int key, const struct pair *table, bool strict)
 {
@@ -80,17 +91,27 @@ static int handle_device(int id, int type, int flags, char *name)
 	if (change) {
 		char deviceid[strlen(UINT_MAX_STRING) + 1];
 
-		if (type != XISlavePointer && type != XISlaveKeyboard) {
+		/* Masters come and go with seats, see seat.c */
+		if (type == XIMasterPointer || type == XIMasterKeyboard) {
+			if (change->key != XIMasterAdded && change->key != XIMasterRemoved)
+				return change->key;
+		} else if (type != XISlavePointer && type != XISlaveKeyboard) {
 			syslog(LOG_DEBUG, "Skipping dev %d type %s flags %s name %s", id, use ? use->value : "", change->value, name ? name : "<none>");
 			return 0;
-		}
-		if (flags != XIDeviceEnabled && flags != XIDeviceDisabled) {
+		} else if (flags != XIDeviceEnabled && flags != XIDeviceDisabled) {
 			syslog(LOG_DEBUG, "Skipping dev %d type %s flags %s name %s", id, use ? use->value : "", change->value, name ? name : "<none>");
 			return 0;
 		}
 
 		snprintf(deviceid, sizeof(deviceid), "%d", id);
-		exec(use->value, deviceid, change->value, name);
+		notify(&(struct event) {
+			.type   = use->value,
+			.device = deviceid,
+			.status = change->value,
+			.name   = name,
+			.screen = xd->screen,
+			.input  = 1,
+		});
 
 		return change->key;
 	}
@@ -98,25 +119,216 @@ static int handle_device(int id, int type, int flags, char *name)
 	return -1;
 }
 
-static char *get_device_name(Display *display, int deviceid)
+static struct xplugd_device *device_find(int id)
+{
+	for (int i = 0; i < xd->num_devices; i++) {
+		if (xd->devices[i].id == id)
+			return &xd->devices[i];
+	}
+
+	return NULL;
+}
+
+static unsigned int device_caps(XIDeviceInfo *info)
 {
+	unsigned int flags = 0;
+
+	for (int i = 0; i < info->num_classes; i++) {
+		XIAnyClassInfo *any = info->classes[i];
+
+		switch (any->type) {
+		case XIKeyClass:
+			flags |= XPLUGD_CAP_KEYS;
+			break;
+
+		case XIButtonClass:
+			flags |= XPLUGD_CAP_BUTTONS;
+			break;
+
+		case XIValuatorClass:
+			if (((XIValuatorClassInfo *)any)->mode == XIModeAbsolute)
+				flags |= XPLUGD_CAP_ABSOLUTE;
+			else
+				flags |= XPLUGD_CAP_RELATIVE;
+			break;
+
+		case XIScrollClass:
+			flags |= XPLUGD_CAP_SCROLL;
+			break;
+
+		case XITouchClass:
+			if (((XITouchClassInfo *)any)->mode == XIDirectTouch)
+				flags |= XPLUGD_CAP_TOUCHSCREEN;
+			else
+				flags |= XPLUGD_CAP_TOUCHPAD;
+			break;
+		}
+	}
+
+	return flags;
+}
+
+/*
+ * Read the properties set by the X server's input driver, they do not
+ * change for the lifetime of the device so this is only done once.
+ */
+static void device_props(Display *dpy, struct xplugd_device *dev)
+{
+	unsigned long nitems, bytes_after;
+	unsigned char *data = NULL;
+	Atom type;
+	int format;
+
+	dev->vendor_id = dev->product_id = 0;
+	dev->node[0] = 0;
+
+	if (xd->product_atom != None &&
+	    XIGetProperty(dpy, dev->id, xd->product_atom, 0, 2, False, XA_INTEGER, &type, &format,
+			  &nitems, &bytes_after, &data) == Success) {
+		if (type == XA_INTEGER && format == 32 && nitems == 2) {
+			dev->vendor_id  = ((int32_t *)data)[0];
+			dev->product_id = ((int32_t *)data)[1];
+		}
+		if (data)
+			XFree(data);
+		data = NULL;
+	}
+
+	if (xd->node_atom != None &&
+	    XIGetProperty(dpy, dev->id, xd->node_atom, 0, sizeof(dev->node) / 4, False, XA_STRING, &type,
+			  &format, &nitems, &bytes_after, &data) == Success) {
+		if (type == XA_STRING && format == 8)
+			snprintf(dev->node, sizeof(dev->node), "%.*s", (int)nitems, (char *)data);
+		if (data)
+			XFree(data);
+	}
+
+	syslog(LOG_DEBUG, "Device %d %s: usb %04x:%04x node %s caps 0x%x", dev->id, dev->name,
+	       dev->vendor_id, dev->product_id, dev->node, dev->caps);
+}
+
+static void device_set(Display *dpy, struct xplugd_device *dev, XIDeviceInfo *info, int props)
+{
+	dev->id      = info->deviceid;
+	dev->use     = info->use;
+	dev->enabled = info->enabled;
+	snprintf(dev->name, sizeof(dev->name), "%s", info->name);
+
+	if (!props)
+		return;
+
+	dev->caps = device_caps(info);
+	if (info->use == XISlavePointer || info->use == XISlaveKeyboard || info->use == XIFloatingSlave)
+		device_props(dpy, dev);
+}
+
+/*
+ * Query one device and update the cache, returns NULL if the device is
+ * gone or the cache is full.  Properties and capabilities are read if
+ * the device is new, or @added.
+ */
+static struct xplugd_device *device_update(Display *dpy, int id, int added)
+{
+	struct xplugd_device *dev;
 	XIDeviceInfo *info;
-	int i, num_devices;
-	char *name = NULL;
+	int num;
 
-	info = XIQueryDevice(display, XIAllDevices, &num_devices);
+	info = XIQueryDevice(dpy, id, &num);
 	if (!info)
 		return NULL;
 
-	for (i = 0; i < num_devices; i++) {
-		if (info[i].deviceid == deviceid) {
-			name = strdup(info[i].name);
-			break;
-		}
+	dev = device_find(id);
+	if (!dev && xd->num_devices < MAX_DEVICES) {
+		dev = &xd->devices[xd->num_devices++];
+		added = 1;
 	}
+	if (dev && num > 0)
+		device_set(dpy, dev, &info[0], added);
+	XIFreeDeviceInfo(info);
+
+	return dev;
+}
+
+static void device_remove(int id)
+{
+	struct xplugd_device *dev = device_find(id);
+
+	if (!dev)
+		return;
+
+	*dev = xd->devices[--xd->num_devices];
+}
+
+/*
+ * Refresh cache of all input devices, one request
+ */
+int input_refresh(Display *dpy)
+{
+	XIDeviceInfo *info;
+	int i, num;
+
+	info = XIQueryDevice(dpy, XIAllDevices, &num);
+	if (!info)
+		return -1;
+
+	xd->num_devices = 0;
+	for (i = 0; i < num && i < MAX_DEVICES; i++)
+		device_set(dpy, &xd->devices[xd->num_devices++], &info[i], 1);
 	XIFreeDeviceInfo(info);
 
-	return name;
+	return 0;
+}
+
+struct xplugd_device *input_device(int id)
+{
+	return device_find(id);
+}
+
+struct xplugd_device *input_devices(int *num)
+{
+	*num = xd->num_devices;
+	return xd->devices;
+}
+
+/*
+ * Format capabilities as a comma separated list, e.g. "keys,buttons"
+ */
+char *input_caps(unsigned int flags, char *buf, size_t len)
+{
+	const struct pair *c;
+	size_t n = 0;
+
+	buf[0] = 0;
+	for (c = caps; c->value && n < len; c++) {
+		if (flags & c->key)
+			n += snprintf(&buf[n], len - n, "%s%s", n ? "," : "", c->value);
+	}
+
+	return buf;
+}
+
+/*
+ * Parse comma separated list of capabilities, returns -1 on unknown
+ */
+int input_caps_parse(const char *list, unsigned int *flags)
+{
+	char buf[128], *tok, *ptr;
+
+	snprintf(buf, sizeof(buf), "%s", list);
+	*flags = 0;
+	for (tok = strtok_r(buf, ",", &ptr); tok; tok = strtok_r(NULL, ",", &ptr)) {
+		const struct pair *c;
+
+		for (c = caps; c->value; c++) {
+			if (!strcmp(c->value, tok))
+				break;
+		}
+		if (!c->value)
+			return -1;
+		*flags |= c->key;
+	}
+
+	return 0;
 }
 
 static void handle_event(XIHierarchyEvent *event)
@@ -124,23 +336,36 @@ static void handle_event(XIHierarchyEvent *event)
 	int i;
 
 	for (i = 0; i < event->num_info; i++) {
-		int flags = event->info[i].flags;
+		XIHierarchyInfo *hi = &event->info[i];
+		int flags = hi->flags;
+		struct xplugd_device *dev;
 		int j = 16;
 
+		dev = device_find(hi->deviceid);
+		if (!dev || (hi->flags & (XIMasterAdded | XISlaveAdded | XIDeviceEnabled)))
+			dev = device_update(event->display, hi->deviceid, hi->flags & XISlaveAdded);
+
 		while (flags && j) {
 			int ret = 0;
-			char *name;
 
-			name = get_device_name(event->display, event->info[i].deviceid);
-			ret = handle_device(event->info[i].deviceid, event->info[i].use, flags, name);
-			free(name);
+			ret = handle_device(hi->deviceid, hi->use, flags, dev ? dev->name : NULL);
 			if (ret == -1)
 				break;
 
 			j--;
 			flags -= ret;
 		}
+
+		if (hi->flags & (XIMasterRemoved | XISlaveRemoved)) {
+			device_remove(hi->deviceid);
+		} else if (dev) {
+			dev->use     = hi->use;
+			dev->enabled = hi->enabled;
+		}
 	}
+
+	/* Devices assigned to seats by rules, in one request */
+	seat_flush(event->display);
 }
 
 int input_init(Display *dpy)
@@ -148,9 +373,9 @@ int input_init(Display *dpy)
 	XIEventMask mask;
 	int event, error;
 
-	if (!XQueryExtension(dpy, "XInputExtension", &xi_opcode, &event, &error)) {
-		syslog(LOG_ERR, "X Input extension not available\n");
-		exit(1);
+	if (!XQueryExtension(dpy, "XInputExtension", &xd->xi_opcode, &event, &error)) {
+		syslog(LOG_ERR, "X Input extension not available on %s", DisplayString(dpy));
+		return -1;
 	}
 
 	mask.deviceid = XIAllDevices;
@@ -158,11 +383,21 @@ int input_init(Display *dpy)
 	mask.mask = calloc(mask.mask_len, sizeof(char));
 	if (!mask.mask) {
 		syslog(LOG_ERR, "Failed initializing X input module: %s", strerror(errno));
-		exit(1);
+		return -1;
 	}
 
+	xd->product_atom = XInternAtom(dpy, "Device Product ID", True);
+	xd->node_atom    = XInternAtom(dpy, "Device Node", True);
+
+	/*
+	 * Devices are shared by all screens, and hierarchy events are sent
+	 * to every window that selects them, so one root is enough
+	 */
 	XISetMask(mask.mask, XI_HierarchyChanged);
 	XISelectEvents(dpy, DefaultRootWindow(dpy), &mask, 1);
+	free(mask.mask);
+
+	input_refresh(dpy);
 
 	return 0;
 }
@@ -174,7 +409,7 @@ int is_input_event(Display *dpy, XEvent *ev)
 	if (!XGetEventData(dpy, c))
 		return 0;
 
-	if (c->type == GenericEvent && c->extension == xi_opcode && c->evtype == XI_HierarchyChanged)
+	if (c->type == GenericEvent && c->extension == xd->xi_opcode && c->evtype == XI_HierarchyChanged)
 		return 1;
 
 	XFreeEventData(dpy, c);
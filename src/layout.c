@@ -0,0 +1,608 @@
+/* Native RandR layout, replaces forking xrandr from the script
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A layout is one or more output clauses separated by ';' or newline:
+ *
+ *    OUTPUT [off] [auto | mode WxH] [rate HZ] [pos XxY]
+ *           [left-of | right-of | above | below OUTPUT] [primary]
+ *           [rotate normal | left | right | inverted]
+ *
+ * Outputs not mentioned are left as they are, unless disconnected, in
+ * which case they are turned off.  The whole layout is
+ * applied in one server grab: CRTCs that are turned off or would not
+ * fit are disabled first, then the screen is resized, and last all
+ * changed CRTCs are set up.
+ */
+
+#include "xplugd.h"
+
+enum {
+	REL_NONE = 0,
+	REL_LEFT_OF,
+	REL_RIGHT_OF,
+	REL_ABOVE,
+	REL_BELOW,
+};
+
+static const char *rotations[] = { "normal", "left", "inverted", "right", NULL };
+
+static struct layout_output *find(struct layout *l, const char *name)
+{
+	for (int i = 0; i < l->num; i++) {
+		if (!strcmp(l->out[i].name, name))
+			return &l->out[i];
+	}
+
+	return NULL;
+}
+
+static int parse_clause(char *clause, struct layout *l)
+{
+	struct layout_output *lo;
+	char *save = NULL, *tok;
+
+	tok = strtok_r(clause, " \t", &save);
+	if (!tok)
+		return 0;	/* Empty clause */
+
+	if (l->num >= MAX_OUTPUTS) {
+		errno = E2BIG;
+		return -1;
+	}
+
+	lo = &l->out[l->num++];
+	memset(lo, 0, sizeof(*lo));
+	snprintf(lo->name, sizeof(lo->name), "%s", tok);
+
+	while ((tok = strtok_r(NULL, " \t", &save))) {
+		char *arg = NULL;
+
+		if (!strcmp(tok, "mode") || !strcmp(tok, "rate") || !strcmp(tok, "pos") ||
+		    !strcmp(tok, "rotate") || !strcmp(tok, "left-of") || !strcmp(tok, "right-of") ||
+		    !strcmp(tok, "above") || !strcmp(tok, "below")) {
+			arg = strtok_r(NULL, " \t", &save);
+			if (!arg)
+				goto error;
+		}
+
+		if (!strcmp(tok, "off")) {
+			lo->off = 1;
+		} else if (!strcmp(tok, "auto")) {
+			lo->automode = 1;
+		} else if (!strcmp(tok, "primary")) {
+			lo->primary = 1;
+		} else if (!strcmp(tok, "mode")) {
+			if (sscanf(arg, "%ux%u", &lo->width, &lo->height) != 2)
+				goto error;
+		} else if (!strcmp(tok, "rate")) {
+			lo->rate = atof(arg);
+		} else if (!strcmp(tok, "pos")) {
+			if (sscanf(arg, "%dx%d", &lo->x, &lo->y) != 2)
+				goto error;
+			lo->pos = 1;
+		} else if (!strcmp(tok, "rotate")) {
+			int i;
+
+			for (i = 0; rotations[i]; i++) {
+				if (!strcmp(rotations[i], arg))
+					break;
+			}
+			if (!rotations[i])
+				goto error;
+			lo->rotation = 1 << i;
+		} else {
+			if (!strcmp(tok, "left-of"))
+				lo->rel = REL_LEFT_OF;
+			else if (!strcmp(tok, "right-of"))
+				lo->rel = REL_RIGHT_OF;
+			else if (!strcmp(tok, "above"))
+				lo->rel = REL_ABOVE;
+			else if (!strcmp(tok, "below"))
+				lo->rel = REL_BELOW;
+			else
+				goto error;
+			snprintf(lo->ref, sizeof(lo->ref), "%s", arg);
+		}
+	}
+
+	return 0;
+error:
+	syslog(LOG_WARNING, "Invalid layout for %s near '%s'", lo->name, tok);
+	errno = EINVAL;
+	return -1;
+}
+
+/*
+ * Parse textual layout @spec, see above
+ */
+int layout_parse(const char *spec, struct layout *l)
+{
+	char buf[LAYOUT_MAX_LEN], *clause, *save = NULL;
+	int rc = 0;
+
+	memset(l, 0, sizeof(*l));
+	if (snprintf(buf, sizeof(buf), "%s", spec) >= (int)sizeof(buf)) {
+		errno = E2BIG;
+		return -1;
+	}
+
+	for (clause = strtok_r(buf, ";\n", &save); clause; clause = strtok_r(NULL, ";\n", &save)) {
+		rc = parse_clause(clause, l);
+		if (rc)
+			break;
+	}
+
+	return rc;
+}
+
+static double mode_rate(XRRModeInfo *mi)
+{
+	if (!mi->hTotal || !mi->vTotal)
+		return 0.0;
+
+	return (double)mi->dotClock / ((double)mi->hTotal * mi->vTotal);
+}
+
+static XRRModeInfo *mode_info(XRRScreenResources *res, RRMode id)
+{
+	for (int i = 0; i < res->nmode; i++) {
+		if (res->modes[i].id == id)
+			return &res->modes[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Pick mode for output: preferred with 'auto', or the one matching the
+ * requested size with the refresh rate closest to the requested one.
+ */
+static RRMode mode_find(XRRScreenResources *res, XRROutputInfo *info, struct layout_output *lo)
+{
+	RRMode best = None;
+	double diff = 1e9;
+
+	if (!lo->width) {
+		if (info->nmode < 1)
+			return None;
+		return info->modes[0];	/* Preferred modes are listed first */
+	}
+
+	for (int i = 0; i < info->nmode; i++) {
+		XRRModeInfo *mi = mode_info(res, info->modes[i]);
+		double d;
+
+		if (!mi || mi->width != lo->width || mi->height != lo->height)
+			continue;
+
+		if (lo->rate > 0) {
+			d = mode_rate(mi) - lo->rate;
+			if (d < 0)
+				d = -d;
+		} else {
+			d = i;
+		}
+		if (d < diff) {
+			diff = d;
+			best = mi->id;
+		}
+	}
+
+	return best;
+}
+
+static int crtc_used(struct layout *l, RRCrtc crtc, struct layout_output *self)
+{
+	for (int i = 0; i < l->num; i++) {
+		if (&l->out[i] != self && !l->out[i].off && l->out[i].crtc == crtc)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Resolve output ids, modes, sizes and CRTCs from the current screen
+ * resources.  Outputs not in the layout are added with their current
+ * settings, so they are accounted for in the screen size.
+ */
+static int resolve(Display *dpy, XRRScreenResources *res, struct layout *l)
+{
+	int i, j;
+
+	for (i = 0; i < res->noutput; i++) {
+		XRROutputInfo *info;
+		struct layout_output *lo;
+
+		info = XRRGetOutputInfo(dpy, res, res->outputs[i]);
+		if (!info)
+			continue;
+
+		lo = find(l, info->name);
+		if (!lo) {
+			if (!info->crtc || l->num >= MAX_OUTPUTS) {
+				XRRFreeOutputInfo(info);
+				continue;
+			}
+
+			/* Not in layout, keep as-is */
+			lo = &l->out[l->num++];
+			memset(lo, 0, sizeof(*lo));
+			snprintf(lo->name, sizeof(lo->name), "%s", info->name);
+			if (info->connection == RR_Disconnected)
+				lo->off = 1;
+		}
+
+		lo->id       = res->outputs[i];
+		lo->cur_crtc = info->crtc;
+		lo->crtc     = info->crtc;
+		if (info->crtc) {
+			XRRCrtcInfo *ci = XRRGetCrtcInfo(dpy, res, info->crtc);
+
+			if (ci) {
+				lo->cur_x        = ci->x;
+				lo->cur_y        = ci->y;
+				lo->cur_w        = ci->width;
+				lo->cur_h        = ci->height;
+				lo->cur_mode     = ci->mode;
+				lo->cur_rotation = ci->rotation;
+				XRRFreeCrtcInfo(ci);
+			}
+		}
+
+		if (lo->off) {
+			XRRFreeOutputInfo(info);
+			continue;
+		}
+
+		if (lo->automode || lo->width)
+			lo->mode = mode_find(res, info, lo);
+		else if (lo->cur_mode)
+			lo->mode = lo->cur_mode;
+		else
+			lo->mode = mode_find(res, info, lo);
+
+		if (!lo->rotation)
+			lo->rotation = lo->cur_rotation ? lo->cur_rotation : RR_Rotate_0;
+
+		if (lo->mode == None || info->connection == RR_Disconnected) {
+			syslog(LOG_WARNING, "Layout: no usable mode for %s, turning it off", lo->name);
+			lo->off = 1;
+		}
+
+		/* Keep current CRTC if possible, otherwise first free one */
+		if (!lo->off && (!lo->crtc || crtc_used(l, lo->crtc, lo))) {
+			lo->crtc = None;
+			for (j = 0; j < info->ncrtc; j++) {
+				if (!crtc_used(l, info->crtcs[j], lo)) {
+					lo->crtc = info->crtcs[j];
+					break;
+				}
+			}
+			if (!lo->crtc) {
+				syslog(LOG_WARNING, "Layout: no free CRTC for %s", lo->name);
+				lo->off = 1;
+			}
+		}
+		XRRFreeOutputInfo(info);
+	}
+
+	for (i = 0; i < l->num; i++) {
+		struct layout_output *lo = &l->out[i];
+		XRRModeInfo *mi;
+
+		if (!lo->id) {
+			syslog(LOG_WARNING, "Layout: no such output %s", lo->name);
+			errno = ENOENT;
+			return -1;
+		}
+
+		if (lo->off)
+			continue;
+
+		mi = mode_info(res, lo->mode);
+		if (!mi) {
+			lo->off = 1;
+			continue;
+		}
+
+		if (lo->rotation & (RR_Rotate_90 | RR_Rotate_270)) {
+			lo->w = mi->height;
+			lo->h = mi->width;
+		} else {
+			lo->w = mi->width;
+			lo->h = mi->height;
+		}
+
+		if (!lo->pos && !lo->rel) {
+			lo->x = lo->cur_crtc ? lo->cur_x : 0;
+			lo->y = lo->cur_crtc ? lo->cur_y : 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Place relative outputs, in as many passes as needed to resolve
+ * chains like A left-of B, B left-of C.
+ */
+static int place(struct layout *l)
+{
+	int pass, i, left;
+
+	for (pass = 0; pass < l->num + 1; pass++) {
+		left = 0;
+		for (i = 0; i < l->num; i++) {
+			struct layout_output *lo = &l->out[i];
+			struct layout_output *ref;
+
+			if (lo->off || !lo->rel || lo->placed)
+				continue;
+
+			ref = find(l, lo->ref);
+			if (!ref || ref->off) {
+				syslog(LOG_WARNING, "Layout: %s placed relative to unknown or disabled %s",
+				       lo->name, lo->ref);
+				lo->rel = REL_NONE;
+				continue;
+			}
+			if (ref->rel && !ref->placed) {
+				left++;
+				continue;
+			}
+
+			switch (lo->rel) {
+			case REL_LEFT_OF:
+				lo->x = ref->x - (int)lo->w;
+				lo->y = ref->y;
+				break;
+			case REL_RIGHT_OF:
+				lo->x = ref->x + (int)ref->w;
+				lo->y = ref->y;
+				break;
+			case REL_ABOVE:
+				lo->x = ref->x;
+				lo->y = ref->y - (int)lo->h;
+				break;
+			case REL_BELOW:
+				lo->x = ref->x;
+				lo->y = ref->y + (int)ref->h;
+				break;
+			}
+			lo->placed = 1;
+		}
+
+		if (!left)
+			return 0;
+	}
+
+	syslog(LOG_WARNING, "Layout: circular output placement");
+	errno = ELOOP;
+	return -1;
+}
+
+/*
+ * Apply parsed layout @spec to screen @scr in a single server grab.
+ * The spec is not modified, so a stored layout can be applied again.
+ */
+int layout_apply(Display *dpy, int scr, const struct layout *spec)
+{
+	struct layout copy = *spec, *l = &copy;
+	int min_x = INT32_MAX, min_y = INT32_MAX, width = 0, height = 0;
+	int minw, minh, maxw, maxh, cur_w, cur_h, i, rc = -1;
+	Window root = RootWindow(dpy, scr);
+	XRRScreenResources *res;
+
+	XGrabServer(dpy);
+	res = XRRGetScreenResourcesCurrent(dpy, root);
+	if (!res)
+		goto done;
+
+	if (resolve(dpy, res, l) || place(l))
+		goto done;
+
+	/* Normalize so the top left output is at 0x0, like xrandr */
+	for (i = 0; i < l->num; i++) {
+		if (l->out[i].off)
+			continue;
+		if (l->out[i].x < min_x)
+			min_x = l->out[i].x;
+		if (l->out[i].y < min_y)
+			min_y = l->out[i].y;
+	}
+	for (i = 0; i < l->num; i++) {
+		struct layout_output *lo = &l->out[i];
+
+		if (lo->off)
+			continue;
+
+		lo->x -= min_x;
+		lo->y -= min_y;
+		if (lo->x + (int)lo->w > width)
+			width = lo->x + lo->w;
+		if (lo->y + (int)lo->h > height)
+			height = lo->y + lo->h;
+	}
+
+	if (!width || !height) {
+		syslog(LOG_WARNING, "Layout: refusing to turn off all outputs");
+		errno = EINVAL;
+		goto done;
+	}
+
+	if (XRRGetScreenSizeRange(dpy, root, &minw, &minh, &maxw, &maxh) &&
+	    (width > maxw || height > maxh)) {
+		syslog(LOG_WARNING, "Layout: %dx%d exceeds max screen size %dx%d", width, height, maxw, maxh);
+		errno = ERANGE;
+		goto done;
+	}
+	if (width < minw)
+		width = minw;
+	if (height < minh)
+		height = minh;
+
+	/*
+	 * Disable CRTCs turned off, moved, or outside the new screen.  A
+	 * CRTC may drive clones, all of them are now off and must be set
+	 * up again below, even the ones not moving.
+	 */
+	for (i = 0; i < l->num; i++) {
+		struct layout_output *lo = &l->out[i];
+		RRCrtc crtc = lo->cur_crtc;
+		int outside, j;
+
+		if (!lo->cur_crtc)
+			continue;
+
+		/* Until reconfigured the CRTC keeps its current size */
+		outside = lo->cur_x + (int)lo->cur_w > width || lo->cur_y + (int)lo->cur_h > height;
+		if (!lo->off && lo->crtc == lo->cur_crtc && !outside)
+			continue;
+
+		XRRSetCrtcConfig(dpy, res, crtc, CurrentTime, 0, 0, None, RR_Rotate_0, NULL, 0);
+		for (j = 0; j < l->num; j++) {
+			if (l->out[j].cur_crtc == crtc)
+				l->out[j].cur_crtc = None;
+		}
+	}
+
+	/*
+	 * Xlib's screen size may be stale, see randr_screen_size(), but
+	 * every resize keeps its mm per pixel, so it still gives the DPI
+	 */
+	randr_screen_size(dpy, scr, &cur_w, &cur_h);
+	if (width != cur_w || height != cur_h) {
+		int mmw = (int)((double)DisplayWidthMM(dpy, scr) * width / DisplayWidth(dpy, scr));
+		int mmh = (int)((double)DisplayHeightMM(dpy, scr) * height / DisplayHeight(dpy, scr));
+
+		syslog(LOG_DEBUG, "Layout: screen size %dx%d (%dx%d mm)", width, height, mmw, mmh);
+		XRRSetScreenSize(dpy, root, width, height, mmw, mmh);
+	}
+
+	for (i = 0; i < l->num; i++) {
+		struct layout_output *lo = &l->out[i];
+
+		if (lo->off)
+			continue;
+
+		if (lo->cur_crtc == lo->crtc && lo->cur_x == lo->x && lo->cur_y == lo->y &&
+		    lo->cur_mode == lo->mode && lo->cur_rotation == lo->rotation)
+			continue;
+
+		syslog(LOG_DEBUG, "Layout: %s %ux%u+%d+%d", lo->name, lo->w, lo->h, lo->x, lo->y);
+		if (XRRSetCrtcConfig(dpy, res, lo->crtc, CurrentTime, lo->x, lo->y, lo->mode,
+				     lo->rotation, &lo->id, 1) != Success)
+			syslog(LOG_WARNING, "Layout: failed setting up %s", lo->name);
+	}
+
+	for (i = 0; i < l->num; i++) {
+		if (l->out[i].primary && !l->out[i].off) {
+			XRRSetOutputPrimary(dpy, root, l->out[i].id);
+			break;
+		}
+	}
+	rc = 0;
+done:
+	if (res)
+		XRRFreeScreenResources(res);
+	XUngrabServer(dpy);
+	XSync(dpy, False);
+
+	if (!rc)
+		randr_refresh(dpy, 0);
+
+	return rc;
+}
+
+/*
+ * Format current layout of all connected outputs on screen @scr, in
+ * the same syntax as layout_parse(), for storing in a profile.
+ */
+int layout_current(Display *dpy, int scr, char *buf, size_t len)
+{
+	Window root = RootWindow(dpy, scr);
+	XRRScreenResources *res;
+	RROutput primary;
+	size_t n = 0;
+	int i;
+
+	res = XRRGetScreenResourcesCurrent(dpy, root);
+	if (!res)
+		return -1;
+
+	buf[0] = 0;
+	primary = XRRGetOutputPrimary(dpy, root);
+	for (i = 0; i < res->noutput && n < len; i++) {
+		XRROutputInfo *info;
+		XRRCrtcInfo *ci = NULL;
+		XRRModeInfo *mi = NULL;
+
+		info = XRRGetOutputInfo(dpy, res, res->outputs[i]);
+		if (!info)
+			continue;
+
+		if (info->connection != RR_Connected) {
+			XRRFreeOutputInfo(info);
+			continue;
+		}
+
+		if (info->crtc)
+			ci = XRRGetCrtcInfo(dpy, res, info->crtc);
+		if (ci)
+			mi = mode_info(res, ci->mode);
+
+		if (mi) {
+			int rot;
+
+			for (rot = 0; rotations[rot + 1]; rot++) {
+				if (ci->rotation & (1 << rot))
+					break;
+			}
+			n += snprintf(&buf[n], len - n, "%s%s mode %ux%u rate %.2f pos %dx%d rotate %s%s",
+				      n ? "; " : "", info->name, mi->width, mi->height, mode_rate(mi),
+				      ci->x, ci->y, rotations[rot], res->outputs[i] == primary ? " primary" : "");
+		} else {
+			n += snprintf(&buf[n], len - n, "%s%s off", n ? "; " : "", info->name);
+		}
+
+		if (ci)
+			XRRFreeCrtcInfo(ci);
+		XRRFreeOutputInfo(info);
+	}
+	XRRFreeScreenResources(res);
+
+	if (n >= len) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,274 @@
+/* DisplayPort link-status monitoring and retraining
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * When link training of a DisplayPort/USB-C sink fails, e.g. behind a
+ * flaky dock, the kernel sets the output's "link-status" property to
+ * Bad and the screen stays black until the mode is set again.  We do
+ * that ourselves: the CRTC is turned off and back on with its current
+ * configuration, in one server grab.  Only with "retrain" in
+ * xplugd.conf, otherwise output property changes are not selected.
+ *
+ * The link is checked again after each retrain, with a delay doubling
+ * every time, and retrained up to LINK_RETRIES times.  Every step is
+ * logged and, if a rule or subscriber asks for it, sent as a "link"
+ * event with status bad, good, or failed.
+ */
+
+#include <X11/Xatom.h>
+#include "xplugd.h"
+
+struct link {
+	struct xdisplay *d;		/* NULL: unused */
+	RROutput         id;
+	int              screen;
+	int              tries;
+};
+
+static struct link links[MAX_OUTPUTS];
+
+static struct link *link_find(RROutput id, int alloc)
+{
+	struct link *free_slot = NULL;
+	int i;
+
+	for (i = 0; i < MAX_OUTPUTS; i++) {
+		if (links[i].d == xd && links[i].id == id)
+			return &links[i];
+		if (!links[i].d && !free_slot)
+			free_slot = &links[i];
+	}
+
+	if (!alloc || !free_slot)
+		return NULL;
+
+	free_slot->d     = xd;
+	free_slot->id    = id;
+	free_slot->tries = 0;
+
+	return free_slot;
+}
+
+static void link_notify(struct link *l, char *status)
+{
+	struct xplugd_output *o = NULL;
+	int i, num;
+
+	if (!conf_wants("link") && !sock_wants("link"))
+		return;
+
+	o = randr_outputs(&num);
+	for (i = 0; i < num; i++) {
+		if (o[i].id == l->id)
+			break;
+	}
+	if (i == num)
+		return;
+
+	notify(&(struct event) {
+		.type   = "link",
+		.device = o[i].name,
+		.status = status,
+		.name   = o[i].model,
+		.screen = l->screen,
+		.output = &o[i],
+	});
+}
+
+/*
+ * Current link-status of output @id, 1 if Good, 0 if Bad, -1 on error
+ */
+static int link_status(Display *dpy, RROutput id)
+{
+	unsigned long nitems, bytes_after;
+	unsigned char *data = NULL;
+	Atom type, value;
+	int format;
+
+	if (XRRGetOutputProperty(dpy, id, xd->link_atom, 0, 1, False, False, XA_ATOM, &type, &format,
+				 &nitems, &bytes_after, &data) != Success || !data)
+		return -1;
+
+	if (type != XA_ATOM || format != 32 || nitems < 1) {
+		XFree(data);
+		return -1;
+	}
+	value = *(Atom *)data;
+	XFree(data);
+
+	return value != xd->link_bad;
+}
+
+/*
+ * Set the current mode again, off and on, since the server ignores a
+ * configuration identical to the current one.  Returns 1 if the output
+ * is off, nothing to retrain.
+ */
+static int retrain(Display *dpy, struct link *l)
+{
+	XRRScreenResources *res;
+	XRRCrtcInfo *ci = NULL;
+	XRROutputInfo *info;
+	int rc = -1;
+
+	res = XRRGetScreenResourcesCurrent(dpy, xd->screens[l->screen].root);
+	if (!res)
+		return -1;
+
+	info = XRRGetOutputInfo(dpy, res, l->id);
+	if (!info)
+		goto done;
+	if (info->crtc)
+		ci = XRRGetCrtcInfo(dpy, res, info->crtc);
+	if (!ci || ci->mode == None) {
+		syslog(LOG_NOTICE, "Link on %s is bad, but the output is off", info->name);
+		rc = 1;
+		goto done;
+	}
+
+	syslog(LOG_NOTICE, "Link on %s is bad, retraining %ux%u+%d+%d, attempt %d of %d", info->name,
+	       ci->width, ci->height, ci->x, ci->y, l->tries, LINK_RETRIES);
+
+	XGrabServer(dpy);
+	XRRSetCrtcConfig(dpy, res, info->crtc, CurrentTime, 0, 0, None, RR_Rotate_0, NULL, 0);
+	if (XRRSetCrtcConfig(dpy, res, info->crtc, CurrentTime, ci->x, ci->y, ci->mode, ci->rotation,
+			     ci->outputs, ci->noutput) == Success)
+		rc = 0;
+	XUngrabServer(dpy);
+	XFlush(dpy);
+done:
+	if (ci)
+		XRRFreeCrtcInfo(ci);
+	if (info)
+		XRRFreeOutputInfo(info);
+	XRRFreeScreenResources(res);
+
+	return rc;
+}
+
+static void check_cb(void *arg);
+
+/*
+ * Retrain, and check the result after a delay doubling with each try
+ */
+static void attempt(Display *dpy, struct link *l)
+{
+	int rc;
+
+	l->tries++;
+	rc = retrain(dpy, l);
+	if (rc > 0) {
+		l->d = NULL;
+		return;
+	}
+	if (rc)
+		syslog(LOG_WARNING, "Failed retraining link, attempt %d", l->tries);
+
+	loop_timer(LINK_RETRY_MS << (l->tries - 1), check_cb, l);
+}
+
+static void recovered(struct link *l)
+{
+	loop_timer_del(check_cb, l);
+	if (l->tries) {
+		syslog(LOG_NOTICE, "Link recovered after %d retrain%s", l->tries, l->tries > 1 ? "s" : "");
+		link_notify(l, "good");
+	}
+	l->d = NULL;
+}
+
+static void check_cb(void *arg)
+{
+	struct link *l = arg;
+	int status;
+
+	xd = l->d;
+	status = link_status(xd->dpy, l->id);
+	if (status == 1) {
+		recovered(l);
+		return;
+	}
+
+	if (l->tries >= LINK_RETRIES) {
+		syslog(LOG_ERR, "Link still bad after %d retrains, giving up", l->tries);
+		link_notify(l, "failed");
+		l->tries++;		/* Until Good, or the display is closed */
+		return;
+	}
+
+	attempt(xd->dpy, l);
+}
+
+/*
+ * The link-status property of output @id changed
+ */
+void link_event(Display *dpy, int scr, RROutput id)
+{
+	struct link *l;
+	int status;
+
+	status = link_status(dpy, id);
+	if (status < 0)
+		return;
+
+	if (status) {
+		l = link_find(id, 0);
+		if (l)
+			recovered(l);
+		return;
+	}
+
+	l = link_find(id, 1);
+	if (!l) {
+		syslog(LOG_WARNING, "Too many bad links, not retraining");
+		return;
+	}
+
+	/* Already retraining, or given up */
+	if (l->tries)
+		return;
+
+	l->screen = scr;
+	link_notify(l, "bad");
+	attempt(dpy, l);
+}
+
+/*
+ * Forget the links of the current display, when it is closed
+ */
+void link_exit(void)
+{
+	for (int i = 0; i < MAX_OUTPUTS; i++) {
+		if (links[i].d != xd)
+			continue;
+
+		loop_timer_del(check_cb, &links[i]);
+		links[i].d = NULL;
+	}
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
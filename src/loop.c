@@ -0,0 +1,233 @@
+/* Main loop, poll() for X and other file descriptors
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <poll.h>
+#include <time.h>
+#include "xplugd.h"
+
+static struct {
+	void (*cb)(int, void *);
+	void  *arg;
+} handler[LOOP_MAX_FDS];
+
+static struct pollfd fds[LOOP_MAX_FDS];
+static int num_fds;
+
+static struct {
+	struct timespec when;
+	void (*cb)(void *);
+	void  *arg;
+} timers[LOOP_MAX_TIMERS];
+static int num_timers;
+
+/*
+ * Register @cb to be called when @fd is readable.  A NULL @cb is
+ * allowed, e.g. for the X connection which is drained by the caller
+ * of loop_poll() anyway.
+ */
+int loop_add(int fd, void (*cb)(int, void *), void *arg)
+{
+	if (num_fds >= LOOP_MAX_FDS) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* Slot may be reused in the same loop_poll(), see loop_del() */
+	fds[num_fds].fd      = fd;
+	fds[num_fds].events  = POLLIN;
+	fds[num_fds].revents = 0;
+	handler[num_fds].cb  = cb;
+	handler[num_fds].arg = arg;
+	num_fds++;
+
+	return 0;
+}
+
+/*
+ * Also wake up when @fd is writable, for callbacks with queued output
+ */
+void loop_output(int fd, int on)
+{
+	for (int i = 0; i < num_fds; i++) {
+		if (fds[i].fd != fd)
+			continue;
+
+		if (on)
+			fds[i].events |= POLLOUT;
+		else
+			fds[i].events &= ~POLLOUT;
+		break;
+	}
+}
+
+void loop_del(int fd)
+{
+	for (int i = 0; i < num_fds; i++) {
+		if (fds[i].fd != fd)
+			continue;
+
+		num_fds--;
+		fds[i] = fds[num_fds];
+		handler[i] = handler[num_fds];
+		break;
+	}
+}
+
+/* Rounded up, so poll() never returns before a timer is due */
+static long msec_until(const struct timespec *now, const struct timespec *when)
+{
+	long long nsec;
+
+	nsec = (long long)(when->tv_sec - now->tv_sec) * 1000000000LL + (when->tv_nsec - now->tv_nsec);
+	if (nsec <= 0)
+		return 0;
+
+	return (nsec + 999999) / 1000000;
+}
+
+/*
+ * Call @cb once, in @msec.  A pending timer with the same @cb and @arg
+ * is moved to the new time.
+ */
+int loop_timer(int msec, void (*cb)(void *), void *arg)
+{
+	struct timespec now;
+	int i;
+
+	for (i = 0; i < num_timers; i++) {
+		if (timers[i].cb == cb && timers[i].arg == arg)
+			break;
+	}
+	if (i == num_timers) {
+		if (num_timers >= LOOP_MAX_TIMERS) {
+			errno = ENOMEM;
+			return -1;
+		}
+		num_timers++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timers[i].when.tv_sec  = now.tv_sec + msec / 1000;
+	timers[i].when.tv_nsec = now.tv_nsec + (msec % 1000) * 1000000L;
+	if (timers[i].when.tv_nsec >= 1000000000L) {
+		timers[i].when.tv_sec++;
+		timers[i].when.tv_nsec -= 1000000000L;
+	}
+	timers[i].cb  = cb;
+	timers[i].arg = arg;
+
+	return 0;
+}
+
+void loop_timer_del(void (*cb)(void *), void *arg)
+{
+	for (int i = 0; i < num_timers; i++) {
+		if (timers[i].cb != cb || timers[i].arg != arg)
+			continue;
+
+		timers[i] = timers[--num_timers];
+		break;
+	}
+}
+
+/*
+ * Shorten poll() @timeout to the first pending timer
+ */
+static int timer_timeout(int timeout)
+{
+	struct timespec now;
+
+	if (!num_timers)
+		return timeout;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (int i = 0; i < num_timers; i++) {
+		long msec = msec_until(&now, &timers[i].when);
+
+		if (msec < 0)
+			msec = 0;
+		if (timeout < 0 || msec < timeout)
+			timeout = msec;
+	}
+
+	return timeout;
+}
+
+static void timer_run(void)
+{
+	struct timespec now;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < num_timers; i++) {
+		void (*cb)(void *) = timers[i].cb;
+		void *arg = timers[i].arg;
+
+		if (msec_until(&now, &timers[i].when) > 0)
+			continue;
+
+		/* Callback may add, or delete, timers */
+		timers[i--] = timers[--num_timers];
+		cb(arg);
+	}
+}
+
+/*
+ * Wait up to @timeout msec for any registered descriptor, or the next
+ * timer, then call the callbacks of all expired timers and readable
+ * descriptors.  Returns the number of descriptors that were handled,
+ * or -1 on error or signal.
+ */
+int loop_poll(int timeout)
+{
+	int num;
+
+	num = poll(fds, num_fds, timer_timeout(timeout));
+	if (num_timers)
+		timer_run();
+	if (num <= 0)
+		return num;
+
+	for (int i = 0; i < num_fds; i++) {
+		struct pollfd pfd = fds[i];
+
+		if (!pfd.revents)
+			continue;
+
+		fds[i].revents = 0;
+		if (handler[i].cb)
+			handler[i].cb(pfd.fd, handler[i].arg);
+
+		/* Callback may have removed itself, or another descriptor */
+		if (i < num_fds && fds[i].fd != pfd.fd)
+			i--;
+	}
+
+	return num;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,163 @@
+/* Load plugins and dispatch events to them
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <dlfcn.h>
+#include "xplugd.h"
+
+static const struct xplugd_plugin *plugins[PLUGIN_MAX];
+static int num_plugins;
+
+static const struct xplugd_output *api_outputs(int *num)
+{
+	return randr_outputs(num);
+}
+
+static const struct xplugd_device *api_devices(int *num)
+{
+	return input_devices(num);
+}
+
+static int api_layout(const char *spec)
+{
+	struct layout l;
+
+	if (layout_parse(spec, &l))
+		return -1;
+
+	return layout_apply(xd->dpy, xd->screen, &l);
+}
+
+static struct xplugd_api api = {
+	.abi     = XPLUGD_PLUGIN_ABI,
+	.outputs = api_outputs,
+	.devices = api_devices,
+	.layout  = api_layout,
+};
+
+static void plugin_exit(void)
+{
+	while (num_plugins > 0) {
+		const struct xplugd_plugin *p = plugins[--num_plugins];
+
+		if (p->exit)
+			p->exit();
+	}
+}
+
+/*
+ * Load plugin from @path, relative paths are looked up in PLUGINDIR.
+ * The plugin stays loaded for the lifetime of the daemon.
+ */
+int plugin_load(Display *dpy, const char *path, int argc, char *argv[])
+{
+	const struct xplugd_plugin *p;
+	char buf[256];
+	void *handle;
+
+	if (num_plugins >= PLUGIN_MAX) {
+		syslog(LOG_WARNING, "Too many plugins, skipping %s", path);
+		return -1;
+	}
+
+	if (!strchr(path, '/')) {
+		snprintf(buf, sizeof(buf), "%s/%s", PLUGINDIR, path);
+		path = buf;
+	}
+
+	handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+		syslog(LOG_WARNING, "Failed loading plugin: %s", dlerror());
+		return -1;
+	}
+
+	p = dlsym(handle, "xplugd_plugin");
+	if (!p) {
+		syslog(LOG_WARNING, "Not an xplugd plugin %s, missing xplugd_plugin", path);
+		goto fail;
+	}
+	if (p->abi == 0 || p->abi > XPLUGD_PLUGIN_ABI) {
+		syslog(LOG_WARNING, "Plugin %s built for ABI %u, daemon has %u", path, p->abi, XPLUGD_PLUGIN_ABI);
+		goto fail;
+	}
+
+	api.dpy = dpy;
+	if (p->init && p->init(&api, argc, argv)) {
+		syslog(LOG_WARNING, "Plugin %s failed to initialize", p->name ? p->name : path);
+		goto fail;
+	}
+
+	if (!num_plugins)
+		atexit(plugin_exit);
+	plugins[num_plugins++] = p;
+	syslog(LOG_INFO, "Loaded plugin %s from %s", p->name ? p->name : "", path);
+
+	return 0;
+fail:
+	dlclose(handle);
+	return -1;
+}
+
+/*
+ * Call all plugins for @ev, returns 1 if any of them handled it.  The
+ * other RandR events, crtc, property, etc., have no plugin callback.
+ */
+int plugin_run(struct event *ev)
+{
+	struct xplugd_event pev;
+	int i, handled = 0;
+
+	if (!num_plugins)
+		return 0;
+
+	pev.type    = ev->type;
+	pev.device  = ev->device;
+	pev.status  = ev->status;
+	pev.name    = ev->name;
+	pev.display = xd->name;
+	pev.screen  = ev->screen;
+	api.dpy     = xd->dpy;
+
+	if (!strcmp(ev->type, "display")) {
+		const struct monitor_info *edid = randr_edid(ev->output);
+
+		for (i = 0; i < num_plugins; i++) {
+			if (plugins[i]->on_display && plugins[i]->on_display(&pev, ev->output, edid) > 0)
+				handled = 1;
+		}
+	} else if (ev->input) {
+		const struct xplugd_device *dev = input_device(atoi(ev->device));
+
+		for (i = 0; i < num_plugins; i++) {
+			if (plugins[i]->on_input && plugins[i]->on_input(&pev, dev) > 0)
+				handled = 1;
+		}
+	}
+
+	return handled;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,157 @@
+/* xplugd plugin API, in-process event handlers
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A plugin is a shared object, listed in xplugd.conf:
+ *
+ *    plugin /path/to/foo.so [ARG ...]
+ *
+ * which exports one symbol, xplugd_plugin, of the type below:
+ *
+ *    #include <xplugd/plugin.h>
+ *
+ *    static int on_display(const struct xplugd_event *ev, const struct xplugd_output *out,
+ *                          const struct monitor_info *edid)
+ *    {
+ *            ...
+ *            return 0;
+ *    }
+ *
+ *    const struct xplugd_plugin xplugd_plugin = {
+ *            .abi        = XPLUGD_PLUGIN_ABI,
+ *            .name       = "foo",
+ *            .on_display = on_display,
+ *    };
+ *
+ * Callbacks run in the daemon's event loop, with its X connection, so
+ * they must not block.  All pointers passed to them point to the
+ * daemon's own data, they are only valid during the call, and may be
+ * NULL if the daemon has no such data, e.g. no EDID.  Returning a
+ * value > 0 from on_input() or on_display() means the event was handled
+ * and the script is not called.
+ *
+ * ABI 1 is frozen from the first release with plugin support, until
+ * then the structs may still change.  After that the ABI is only
+ * extended: new members are appended to the structs, and
+ * XPLUGD_PLUGIN_ABI is bumped.  The outputs() and devices() arrays are
+ * the exception, appending would change their stride, so new data for
+ * them gets new accessors.  Plugins built for a newer ABI than the
+ * daemon's are refused.
+ */
+
+#ifndef XPLUGD_PLUGIN_H_
+#define XPLUGD_PLUGIN_H_
+
+#include <stdint.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include "edid.h"
+
+#define XPLUGD_PLUGIN_ABI 1
+
+/* Cached RandR topology, one entry per output */
+struct xplugd_output {
+	RROutput      id;
+	char          name[32];
+	int           connection;	/* RR_Connected, RR_Disconnected, ... */
+
+	RRCrtc        crtc;		/* None if disabled */
+	int           x, y;
+	unsigned int  width, height;
+	RRMode        mode;
+	Rotation      rotation;
+
+	unsigned long mm_width, mm_height;
+	uint64_t      edid_hash;	/* 0 if no EDID */
+	char          vendor[4];	/* EDID summary, may be empty */
+	unsigned int  product;
+	unsigned int  serial;
+	char          model[14];
+
+	int           screen;		/* X screen of the output */
+};
+
+/* Input device capabilities, from the XI2 device classes */
+#define XPLUGD_CAP_KEYS        0x01
+#define XPLUGD_CAP_BUTTONS     0x02
+#define XPLUGD_CAP_RELATIVE    0x04	/* Relative valuators, e.g. mouse */
+#define XPLUGD_CAP_ABSOLUTE    0x08	/* Absolute valuators, e.g. tablet */
+#define XPLUGD_CAP_SCROLL      0x10
+#define XPLUGD_CAP_TOUCHSCREEN 0x20	/* XIDirectTouch */
+#define XPLUGD_CAP_TOUCHPAD    0x40	/* XIDependentTouch */
+
+/* Cached XInput devices */
+struct xplugd_device {
+	int           id;
+	int           use;		/* XISlavePointer, XISlaveKeyboard, ... */
+	int           enabled;
+	char          name[64];
+
+	/* Read once, when the device is added, may be 0 or empty */
+	unsigned int  vendor_id;	/* USB vendor:product, Device Product ID */
+	unsigned int  product_id;
+	char          node[64];		/* Device Node, e.g. /dev/input/event5 */
+	unsigned int  caps;		/* XPLUGD_CAP_* */
+};
+
+/* Event, same fields as the script arguments */
+struct xplugd_event {
+	const char   *type;		/* display, keyboard, pointer */
+	const char   *device;		/* Output name, or XInput device id */
+	const char   *status;		/* connected, disconnected, unknown */
+	const char   *name;		/* Description, may be NULL */
+	const char   *display;		/* X display of the event, e.g. ":0" */
+	int           screen;		/* X screen, inputs: default screen */
+};
+
+/* Provided by the daemon to the plugin's init() */
+struct xplugd_api {
+	unsigned int  abi;		/* XPLUGD_PLUGIN_ABI of the daemon */
+	Display      *dpy;		/* Display of the event being handled */
+
+	const struct xplugd_output *(*outputs)(int *num);
+	const struct xplugd_device *(*devices)(int *num);
+
+	/* Topology of the display of the event, layout of its screen */
+	int         (*layout)(const char *spec);
+};
+
+struct xplugd_plugin {
+	unsigned int  abi;		/* XPLUGD_PLUGIN_ABI built with */
+	const char   *name;
+
+	int         (*init)      (const struct xplugd_api *api, int argc, char *argv[]);
+	void        (*exit)      (void);
+
+	int         (*on_input)  (const struct xplugd_event *ev, const struct xplugd_device *dev);
+	int         (*on_display)(const struct xplugd_event *ev, const struct xplugd_output *out,
+				  const struct monitor_info *edid);
+};
+
+#endif /* XPLUGD_PLUGIN_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,142 @@
+/* PRIME provider pairing, GPUs and display adapters driving each other
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * A hybrid-GPU laptop, or a DisplayLink dock, has more than one RandR
+ * provider.  Outputs of a provider are only usable when it is paired
+ * with the GPU that renders for it, like `xrandr --setprovideroutputsource
+ * SINK SOURCE`.  Pairs listed in xplugd.conf are set up here, at start
+ * and whenever providers change, so new outputs show up without a
+ * script and a second round of hotplug events.
+ *
+ * SOURCE and SINK are provider names, shell globs, or an index as listed
+ * by `xrandr --listproviders`.  Names are often the same for all GPUs
+ * driven by the modesetting driver, use an index then.
+ */
+
+#include <fnmatch.h>
+#include "xplugd.h"
+
+static int match(const char *spec, int index, const char *name)
+{
+	char *end;
+	long num;
+
+	num = strtol(spec, &end, 10);
+	if (end != spec && !*end)
+		return num == index;
+
+	return !fnmatch(spec, name, 0);
+}
+
+static int find(XRRProviderInfo **info, int num, const char *spec)
+{
+	for (int i = 0; i < num; i++) {
+		if (info[i] && match(spec, i, info[i]->name))
+			return i;
+	}
+
+	return -1;
+}
+
+/* Sink already has @source as its output source */
+static int paired(XRRProviderInfo *sink, RRProvider source)
+{
+	for (int i = 0; i < sink->nassociatedproviders; i++) {
+		if (sink->associated_providers[i] == source &&
+		    (sink->associated_capability[i] & RR_Capability_SourceOutput))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Pair the providers of screen @scr as configured.  Returns the number
+ * of new pairs, the caller must then refresh the screen's outputs.
+ */
+int prime_apply(Display *dpy, int scr)
+{
+	XRRProviderInfo *info[MAX_PROVIDERS] = { NULL };
+	const struct prime *pairs;
+	XRRScreenResources *res;
+	XRRProviderResources *pr;
+	int i, num, changed = 0;
+
+	pairs = conf_prime(&num);
+	if (!pairs || xd->rr_version < 104)
+		return 0;
+
+	res = XRRGetScreenResourcesCurrent(dpy, xd->screens[scr].root);
+	if (!res)
+		return 0;
+	pr = XRRGetProviderResources(dpy, xd->screens[scr].root);
+	if (!pr) {
+		XRRFreeScreenResources(res);
+		return 0;
+	}
+
+	if (pr->nproviders > (int)(sizeof(info) / sizeof(info[0])))
+		pr->nproviders = sizeof(info) / sizeof(info[0]);
+	for (i = 0; i < pr->nproviders; i++)
+		info[i] = XRRGetProviderInfo(dpy, res, pr->providers[i]);
+
+	for (i = 0; i < num; i++) {
+		int source, sink;
+
+		source = find(info, pr->nproviders, pairs[i].source);
+		sink   = find(info, pr->nproviders, pairs[i].sink);
+		if (source < 0 || sink < 0 || source == sink)
+			continue;
+
+		if (paired(info[sink], pr->providers[source]))
+			continue;
+
+		if (!(info[source]->capabilities & RR_Capability_SourceOutput) ||
+		    !(info[sink]->capabilities & RR_Capability_SinkOutput)) {
+			syslog(LOG_WARNING, "Provider %s cannot drive the outputs of %s",
+			       info[source]->name, info[sink]->name);
+			continue;
+		}
+
+		syslog(LOG_NOTICE, "Pairing provider %d:%s as output source of %d:%s on %s", source,
+		       info[source]->name, sink, info[sink]->name, xd->name);
+		XRRSetProviderOutputSource(dpy, pr->providers[sink], pr->providers[source]);
+		changed++;
+	}
+
+	for (i = 0; i < pr->nproviders; i++) {
+		if (info[i])
+			XRRFreeProviderInfo(info[i]);
+	}
+	XRRFreeProviderResources(pr);
+	XRRFreeScreenResources(res);
+
+	return changed;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
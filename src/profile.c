@@ -0,0 +1,296 @@
+/* Layout profiles, keyed by a fingerprint of the connected outputs
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The profile file has one line per known combination of displays,
+ * the 64-bit fingerprint in hex followed by a layout, see layout.c:
+ *
+ *    3f0c5a2b9e8d7c61 eDP-1 mode 1920x1080 rate 60.00 pos 0x0 rotate normal; ...
+ *
+ * It is read once at startup, each layout is parsed and stored in a
+ * hash table, so a dock event is handled with one lookup.  The table
+ * is shared by all displays.
+ */
+
+#include "xplugd.h"
+#include "edid.h"
+
+struct profile {
+	uint64_t       fp;
+	char          *spec;
+	struct layout *layout;
+};
+
+static struct profile table[PROFILE_MAX];
+static int num_profiles;
+
+static char *file;
+
+static struct profile *lookup(uint64_t fp, int alloc)
+{
+	unsigned int i, slot = fp & (PROFILE_MAX - 1);
+
+	for (i = 0; i < PROFILE_MAX; i++) {
+		struct profile *p = &table[(slot + i) & (PROFILE_MAX - 1)];
+
+		if (p->fp == fp)
+			return p;
+		if (!p->fp) {
+			if (!alloc || num_profiles >= PROFILE_MAX - 1)
+				return NULL;
+			num_profiles++;
+			p->fp = fp;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+static int store(uint64_t fp, const char *spec)
+{
+	struct layout *l;
+	struct profile *p;
+
+	l = malloc(sizeof(*l));
+	if (!l)
+		return -1;
+
+	if (layout_parse(spec, l) || !l->num) {
+		free(l);
+		errno = EINVAL;
+		return -1;
+	}
+
+	p = lookup(fp, 1);
+	if (!p) {
+		free(l);
+		errno = ENOSPC;
+		return -1;
+	}
+
+	free(p->spec);
+	free(p->layout);
+	p->spec   = strdup(spec);
+	p->layout = l;
+
+	return 0;
+}
+
+static int load(const char *path)
+{
+	char line[SOCK_FRAME_LEN + 32];
+	int lineno = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return errno == ENOENT ? 0 : -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		uint64_t fingerprint;
+		int pos;
+
+		lineno++;
+		line[strcspn(line, "\r\n")] = 0;
+		if (!line[0] || line[0] == '#')
+			continue;
+
+		if (sscanf(line, "%" SCNx64 " %n", &fingerprint, &pos) != 1 || !fingerprint ||
+		    store(fingerprint, &line[pos]))
+			syslog(LOG_WARNING, "%s:%d: invalid profile, skipping", path, lineno);
+	}
+	fclose(fp);
+
+	syslog(LOG_INFO, "Loaded %d layout profiles from %s", num_profiles, path);
+
+	return 0;
+}
+
+/*
+ * Write all profiles to a temporary file and rename it over the old
+ * one, so a crash never leaves a truncated profile file.
+ */
+static int dump(const char *path)
+{
+	char tmp[256];
+	FILE *fp;
+	int i;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (!fp)
+		return -1;
+
+	fprintf(fp, "# Generated by %s, fingerprint and layout per display combination\n", prognm);
+	for (i = 0; i < PROFILE_MAX; i++) {
+		if (table[i].fp && table[i].spec)
+			fprintf(fp, "%016" PRIx64 " %s\n", table[i].fp, table[i].spec);
+	}
+
+	if (fclose(fp) || rename(tmp, path)) {
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int compare(const void *a, const void *b)
+{
+	const struct xplugd_output *oa = *(const struct xplugd_output **)a;
+	const struct xplugd_output *ob = *(const struct xplugd_output **)b;
+
+	return strcmp(oa->name, ob->name);
+}
+
+/*
+ * Hash of the names and EDID hashes of all connected outputs on the
+ * current screen, sorted by name so the result does not depend on the
+ * order of the outputs.  Returns 0 if no output is connected.
+ */
+uint64_t profile_fingerprint(void)
+{
+	unsigned char buf[MAX_OUTPUTS * (sizeof(((struct xplugd_output *)0)->name) + sizeof(uint64_t))];
+	struct xplugd_output *sorted[MAX_OUTPUTS];
+	struct xplugd_output *outputs;
+	size_t len = 0;
+	int i, num, n = 0;
+
+	outputs = randr_outputs(&num);
+	for (i = 0; i < num; i++) {
+		if (outputs[i].connection == RR_Connected && outputs[i].screen == xd->screen)
+			sorted[n++] = &outputs[i];
+	}
+	if (!n)
+		return 0;
+
+	qsort(sorted, n, sizeof(sorted[0]), compare);
+	for (i = 0; i < n; i++) {
+		size_t sz = strlen(sorted[i]->name) + 1;
+
+		memcpy(&buf[len], sorted[i]->name, sz);
+		len += sz;
+		memcpy(&buf[len], &sorted[i]->edid_hash, sizeof(uint64_t));
+		len += sizeof(uint64_t);
+	}
+
+	/* Same FNV-1a as for EDID blobs */
+	return edid_hash(buf, len);
+}
+
+/*
+ * Called on display events, applies the stored layout if the current
+ * combination of displays is known.  Returns 1 if it was, so the
+ * script does not need to be called.
+ */
+int profile_apply(void)
+{
+	struct xscreen *scr = &xd->screens[xd->screen];
+	struct profile *p;
+	uint64_t fp;
+
+	if (!num_profiles)
+		return 0;
+
+	fp = profile_fingerprint();
+	if (!fp)
+		return 0;
+
+	/* Several events for one dock, layout already applied */
+	if (fp == scr->last_fp)
+		return scr->last_match;
+
+	scr->last_fp    = fp;
+	scr->last_match = 0;
+
+	p = lookup(fp, 0);
+	if (!p || !p->layout)
+		return 0;
+
+	syslog(LOG_NOTICE, "Known displays, fingerprint %016" PRIx64 ", applying stored layout", fp);
+	if (layout_apply(xd->dpy, xd->screen, p->layout)) {
+		syslog(LOG_WARNING, "Failed applying stored layout, calling script");
+		return 0;
+	}
+	scr->last_match = 1;
+
+	return 1;
+}
+
+/*
+ * Store current layout for the current combination of displays, e.g.
+ * called by the script after it has set up a new combination.
+ */
+int profile_save(void)
+{
+	struct xscreen *scr = &xd->screens[xd->screen];
+	char spec[SOCK_FRAME_LEN];
+	uint64_t fp;
+
+	if (!file) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	randr_refresh(xd->dpy, 0);
+	fp = profile_fingerprint();
+	if (!fp) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	if (layout_current(xd->dpy, xd->screen, spec, sizeof(spec)) || store(fp, spec))
+		return -1;
+
+	if (dump(file)) {
+		syslog(LOG_ERR, "Failed saving profiles to %s: %s", file, strerror(errno));
+		return -1;
+	}
+
+	syslog(LOG_NOTICE, "Saved layout for fingerprint %016" PRIx64, fp);
+	scr->last_fp    = fp;
+	scr->last_match = 1;
+
+	return 0;
+}
+
+int profile_init(void)
+{
+	file = config_file(PROFILES);
+	if (!file)
+		return -1;
+
+	if (load(file)) {
+		syslog(LOG_ERR, "Failed reading %s: %s", file, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
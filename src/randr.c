@@ -21,6 +21,7 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <X11/Xatom.h>
 #include "xplugd.h"
 #include "edid.h"
 
@@ -42,74 +43,423 @@ static char iface_type_names[6][16] = {
 	"Display Port"
 };
 
-static struct monitor_info *edid_info(Display *dpy, XID output, Atom prop)
+static struct {
+	uint64_t             hash;
+	struct monitor_info *info;
+} cache[EDID_CACHE_SIZE];
+static int cache_next;
+
+/*
+ * Decode EDID, or reuse the monitor info previously decoded from a blob
+ * with the same content hash.  The cache owns the returned data, it is
+ * valid until the next call.
+ */
+static struct monitor_info *edid_lookup(const unsigned char *data, size_t len, uint64_t *hash)
+{
+	struct monitor_info *info;
+	uint64_t h;
+	int i;
+
+	h = edid_hash(data, len);
+	if (hash)
+		*hash = h;
+
+	for (i = 0; i < EDID_CACHE_SIZE; i++) {
+		if (cache[i].info && cache[i].hash == h)
+			return cache[i].info;
+	}
+
+	info = edid_decode(data);
+	if (!info)
+		return NULL;
+
+	free(cache[cache_next].info);
+	cache[cache_next].hash = h;
+	cache[cache_next].info = info;
+	cache_next = (cache_next + 1) % EDID_CACHE_SIZE;
+
+	return info;
+}
+
+static size_t edid_prop(Display *dpy, Atom edid_atom, RROutput output, unsigned char *buf, size_t len)
 {
 	unsigned long nitems, bytes_after;
-	unsigned char *data;
+	unsigned char *data = NULL;
 	Atom actual_type;
 	int actual_format;
 
-	XRRGetOutputProperty(dpy, output, prop, 0, 128, False, False,
-			     AnyPropertyType, &actual_type, &actual_format, &nitems, &bytes_after, &data);
+	if (edid_atom == None)
+		return 0;
+
+	if (XRRGetOutputProperty(dpy, output, edid_atom, 0, len / 4, False, False, AnyPropertyType,
+				 &actual_type, &actual_format, &nitems, &bytes_after, &data) != Success)
+		return 0;
 
-	if (nitems < 128) {
+	if (!data)
+		return 0;
+
+	if (actual_format != 8 || nitems < EDID_BLOCK_LEN) {
 		syslog(LOG_INFO, "Not enough EDID data found.  Need at least 128 bytes, got %lu bytes", nitems);
+		XFree(data);
+		return 0;
+	}
+
+	if (nitems > len)
+		nitems = len;
+	memcpy(buf, data, nitems);
+	XFree(data);
+
+	return edid_length(buf, nitems);
+}
+
+/*
+ * DRM connector id of @output, 0 if the driver does not tell
+ */
+static unsigned int connector_id(Display *dpy, Atom connector_atom, RROutput output)
+{
+	unsigned long nitems, bytes_after;
+	unsigned char *data = NULL;
+	unsigned int id = 0;
+	Atom actual_type;
+	int actual_format;
+
+	if (connector_atom == None)
+		return 0;
+
+	if (XRRGetOutputProperty(dpy, output, connector_atom, 0, 1, False, False, AnyPropertyType,
+				 &actual_type, &actual_format, &nitems, &bytes_after, &data) != Success)
+		return 0;
+
+	if (data && actual_type == XA_INTEGER && actual_format == 32 && nitems == 1)
+		id = *(long *)data;
+	XFree(data);
+
+	return id;
+}
+
+/*
+ * Prefer the kernel's copy of the EDID in sysfs, it is a plain file read
+ * and is up to date right after a hotplug, unlike the RandR property on
+ * some drivers.  Only for local displays, a remote server's outputs are
+ * not ours, and only if the output's CONNECTOR_ID matches exactly one
+ * DRM connector.  Fall back to the RandR property if sysfs has no valid
+ * EDID for it.
+ */
+static struct monitor_info *edid_info(Display *dpy, Atom edid_atom, Atom connector_atom, int local,
+				      RROutput output, const char *name, uint64_t *hash)
+{
+	unsigned char buf[EDID_MAX_LEN];
+	size_t len = 0;
+
+	if (local)
+		len = sysfs_edid(SYSFS_ROOT, name, connector_id(dpy, connector_atom, output), buf, sizeof(buf));
+	if (len)
+		syslog(LOG_DEBUG, "Using EDID for %s from sysfs", name);
+	else
+		len = edid_prop(dpy, edid_atom, output, buf, sizeof(buf));
+	if (!len) {
+		errno = ENOENT;
 		return NULL;
 	}
 
-	return edid_decode(data);
+	return edid_lookup(buf, len, hash);
 }
 
-static void edid_desc(Display *dpy, XRRScreenResources *res, const char *output, char *buf, size_t len)
+/*
+ * Find, or allocate, the cached topology entry for @id
+ */
+static struct xplugd_output *output_find(RROutput id, int alloc)
 {
-	struct monitor_info *info = NULL;
-	Atom *p;
 	int i;
 
-	for (i = 0; i < res->noutput; ++i) {
-		XRROutputInfo *output_info;
-		int j, np;
+	for (i = 0; i < xd->num_outputs; i++) {
+		if (xd->outputs[i].id == id)
+			return &xd->outputs[i];
+	}
 
-		output_info = XRRGetOutputInfo(dpy, res, res->outputs[i]);
-		if (!output_info)
+	if (!alloc || xd->num_outputs >= MAX_OUTPUTS)
+		return NULL;
+
+	memset(&xd->outputs[xd->num_outputs], 0, sizeof(xd->outputs[0]));
+	xd->outputs[xd->num_outputs].id = id;
+
+	return &xd->outputs[xd->num_outputs++];
+}
+
+/*
+ * Update cached topology for one output: connection, CRTC geometry,
+ * and EDID hash and model name if connected.
+ */
+static struct xplugd_output *output_update(Display *dpy, int scr, XRRScreenResources *res, RROutput id,
+					   XRROutputInfo *info)
+{
+	struct monitor_info *edid;
+	struct xplugd_output *o;
+
+	o = output_find(id, 1);
+	if (!o)
+		return NULL;
+
+	snprintf(o->name, sizeof(o->name), "%s", info->name);
+	o->screen     = scr;
+	o->connection = info->connection;
+	o->mm_width   = info->mm_width;
+	o->mm_height  = info->mm_height;
+	o->crtc       = info->crtc;
+	o->x = o->y = o->width = o->height = 0;
+	o->mode       = None;
+	o->rotation   = RR_Rotate_0;
+
+	if (info->crtc) {
+		XRRCrtcInfo *crtc;
+
+		crtc = XRRGetCrtcInfo(dpy, res, info->crtc);
+		if (crtc) {
+			o->x        = crtc->x;
+			o->y        = crtc->y;
+			o->width    = crtc->width;
+			o->height   = crtc->height;
+			o->mode     = crtc->mode;
+			o->rotation = crtc->rotation;
+			XRRFreeCrtcInfo(crtc);
+		}
+	}
+
+	o->edid_hash = 0;
+	o->vendor[0] = 0;
+	o->product   = 0;
+	o->serial    = 0;
+	o->model[0]  = 0;
+	if (info->connection != RR_Connected)
+		return o;
+
+	edid = edid_info(dpy, xd->edid_atom, xd->connector_atom, xd->local, id, info->name, &o->edid_hash);
+	if (!edid) {
+		syslog(LOG_INFO, "Failed decoding EDID data: %s", strerror(errno));
+		return o;
+	}
+
+	syslog(LOG_DEBUG, "MODEL: %s S/N: %s EXTRA: %s",
+	       edid->dsc_product_name, edid->dsc_serial_number, edid->dsc_string);
+	snprintf(o->vendor, sizeof(o->vendor), "%s", edid->manufacturer_code);
+	snprintf(o->model, sizeof(o->model), "%s", edid->dsc_product_name);
+	o->product = edid->product_code;
+	o->serial  = edid->serial_number;
+
+	return o;
+}
+
+/*
+ * Decoded EDID of output, if still in the cache, for plugins
+ */
+const struct monitor_info *randr_edid(const struct xplugd_output *o)
+{
+	if (!o || !o->edid_hash)
+		return NULL;
+
+	for (int i = 0; i < EDID_CACHE_SIZE; i++) {
+		if (cache[i].info && cache[i].hash == o->edid_hash)
+			return cache[i].info;
+	}
+
+	return NULL;
+}
+
+struct xplugd_output *randr_outputs(int *num)
+{
+	*num = xd->num_outputs;
+	return xd->outputs;
+}
+
+/*
+ * Drop cached outputs of @scr the server no longer has, e.g. when a
+ * USB display adapter is unplugged
+ */
+static void prune(int scr, XRRScreenResources *res)
+{
+	int i, j;
+
+	for (i = 0; i < xd->num_outputs; i++) {
+		struct xplugd_output *o = &xd->outputs[i];
+
+		if (o->screen != scr)
 			continue;
 
-		if (output_info->connection != RR_Connected)
+		for (j = 0; j < res->noutput; j++) {
+			if (res->outputs[j] == o->id)
+				break;
+		}
+		if (j < res->noutput)
 			continue;
 
-		if (strcmp(output_info->name, output))
+		syslog(LOG_DEBUG, "Output %s removed", o->name);
+		*o = xd->outputs[--xd->num_outputs];
+		i--;
+	}
+}
+
+static void refresh(Display *dpy, int scr, XRRScreenResources *res)
+{
+	for (int i = 0; i < res->noutput; i++) {
+		XRROutputInfo *info;
+
+		info = XRRGetOutputInfo(dpy, res, res->outputs[i]);
+		if (!info)
 			continue;
 
-		p = XRRListOutputProperties(dpy, res->outputs[i], &np);
-		for (j = 0; j < np; ++j) {
-			if (strcmp(XGetAtomName(dpy, p[j]), "EDID"))
-				continue;
+		output_update(dpy, scr, res, res->outputs[i], info);
+		XRRFreeOutputInfo(info);
+	}
+	prune(scr, res);
+}
 
-			info = edid_info(dpy, res->outputs[i], p[j]);
-		}
-		break;
+static int screen_refresh(Display *dpy, int scr, int probe)
+{
+	Window root = xd->screens[scr].root;
+	XRRScreenResources *res;
+
+	if (probe)
+		res = XRRGetScreenResources(dpy, root);
+	else
+		res = XRRGetScreenResourcesCurrent(dpy, root);
+	if (!res)
+		return -1;
+
+	refresh(dpy, scr, res);
+	XRRFreeScreenResources(res);
+
+	return 0;
+}
+
+/*
+ * Refresh the cached topology of all outputs, on all screens.  With
+ * @probe the X server is asked to re-probe all outputs, which is slow,
+ * otherwise its current view is used.
+ */
+int randr_refresh(Display *dpy, int probe)
+{
+	int scr, rc = 0;
+
+	for (scr = 0; scr < xd->num_screens; scr++) {
+		if (screen_refresh(dpy, scr, probe))
+			rc = -1;
 	}
 
-	if (!info) {
-		syslog(LOG_INFO, "Failed decoding EDID data: %s", strerror(errno));
+	return rc;
+}
+
+/*
+ * Current pixel size of screen @scr, asked from the server.  Xlib's
+ * DisplayWidth() and DisplayHeight() only change in
+ * XRRUpdateConfiguration(), on screen events, which are not always
+ * selected, so they can be stale after the first resize.
+ */
+void randr_screen_size(Display *dpy, int scr, int *width, int *height)
+{
+	unsigned int w, h, border, depth;
+	Window root;
+	int x, y;
+
+	if (!XGetGeometry(dpy, RootWindow(dpy, scr), &root, &x, &y, &w, &h, &border, &depth)) {
+		w = DisplayWidth(dpy, scr);
+		h = DisplayHeight(dpy, scr);
+	}
+
+	*width  = w;
+	*height = h;
+}
+
+/*
+ * Called on kernel DRM hotplug, before the X server has told us.  Make
+ * the server re-probe now and read the EDIDs, so the RandR event that
+ * follows is served from cache.
+ */
+int randr_prewarm(Display *dpy)
+{
+	return randr_refresh(dpy, 1);
+}
+
+/*
+ * Screen of root window @win, events are selected on all of them
+ */
+static int screen_of(Window win)
+{
+	for (int scr = 0; scr < xd->num_screens; scr++) {
+		if (xd->screens[scr].root == win)
+			return scr;
+	}
+
+	return -1;
+}
+
+/*
+ * Re-read one output, e.g. when its EDID property has changed
+ */
+static void output_reload(Display *dpy, int scr, RROutput id)
+{
+	XRRScreenResources *res;
+	XRROutputInfo *info;
+
+	res = XRRGetScreenResourcesCurrent(dpy, xd->screens[scr].root);
+	if (!res)
 		return;
+
+	info = XRRGetOutputInfo(dpy, res, id);
+	if (info) {
+		output_update(dpy, scr, res, id, info);
+		XRRFreeOutputInfo(info);
 	}
+	XRRFreeScreenResources(res);
+}
 
-	syslog(LOG_DEBUG, "MODEL: %s S/N: %s EXTRA: %s",
-	       info->dsc_product_name, info->dsc_serial_number, info->dsc_string);
-	strncpy(buf, info->dsc_product_name, len);
-	free(info);
+/*
+ * Event for a cached output, the description is the EDID model unless
+ * @name is given
+ */
+static void output_notify(char *type, RROutput id, char *status, char *name, int scr)
+{
+	struct xplugd_output *o;
+
+	o = output_find(id, 0);
+	if (!o)
+		return;
+
+	notify(&(struct event) {
+		.type   = type,
+		.device = o->name,
+		.status = status,
+		.name   = name ? name : o->model,
+		.screen = scr,
+		.output = o,
+	});
+}
+
+/*
+ * Output already announced as connected when its provider was paired,
+ * the server's own event for it is a duplicate
+ */
+static int primed(RROutput id, int connection)
+{
+	for (int i = 0; i < xd->num_primed; i++) {
+		if (xd->primed[i] != id)
+			continue;
+
+		xd->primed[i] = xd->primed[--xd->num_primed];
+		return connection == RR_Connected;
+	}
+
+	return 0;
 }
 
-static void handle_event(Display *dpy, XRROutputChangeNotifyEvent *ev)
+static void output_event(Display *dpy, int scr, XRROutputChangeNotifyEvent *ev)
 {
-	static char old_msg[MSG_LEN] = "";
 	XRRScreenResources *res;
 	XRROutputInfo *info;
-	char desc[14] = { 0 };
+	struct xplugd_output *o;
 	char msg[MSG_LEN];
 
-	res = XRRGetScreenResources(ev->display, ev->window);
+	/* The server has already probed outputs when it sends this event */
+	res = XRRGetScreenResourcesCurrent(ev->display, ev->window);
 	if (!res) {
 		syslog(LOG_ERR, "Could not get screen resources");
 		return;
@@ -123,50 +473,393 @@ static void handle_event(Display *dpy, XRROutputChangeNotifyEvent *ev)
 	}
 
 	/* Check for duplicate plug events */
-	snprintf(msg, sizeof(msg), "%s %s", info->name, con_actions[info->connection]);
-	if (!strcmp(msg, old_msg)) {
+	if (primed(ev->output, info->connection)) {
+		syslog(LOG_DEBUG, "Output %s already announced, skipping ...", info->name);
+		goto done;
+	}
+	snprintf(msg, sizeof(msg), "%d %s %s", scr, info->name, con_actions[info->connection]);
+	if (!strcmp(msg, xd->last_msg)) {
 		if (loglevel == LOG_DEBUG)
 			syslog(LOG_DEBUG, "Same message as last time, time %lu, skipping ...", info->timestamp);
 		goto done;
 	}
-	strcpy(old_msg, msg);
+	strcpy(xd->last_msg, msg);
+
+	/*
+	 * Only this output, and its CRTC, the server sends one event per
+	 * output, so the others of a dock are updated by their own event
+	 */
+	output_update(dpy, scr, res, ev->output, info);
+	prune(scr, res);
 
+	/* Pruning moves entries, look ours up again, it may be gone */
+	o = output_find(ev->output, 0);
 	if (loglevel == LOG_DEBUG) {
 		syslog(LOG_DEBUG, "Event: %s %s", info->name, con_actions[info->connection]);
 		syslog(LOG_DEBUG, "Time: %lu", info->timestamp);
 		if (info->crtc == 0) {
 			syslog(LOG_DEBUG, "Size: %lumm x %lumm", info->mm_width, info->mm_height);
-		} else {
-			XRRCrtcInfo *crtc;
-
+		} else if (o) {
 			syslog(LOG_DEBUG, "CRTC: %lu", info->crtc);
-
-			crtc = XRRGetCrtcInfo(dpy, res, info->crtc);
-			if (crtc) {
-				syslog(LOG_DEBUG, "Size: %dx%d", crtc->width, crtc->height);
-				XRRFreeCrtcInfo(crtc);
-			}
+			syslog(LOG_DEBUG, "Size: %ux%u", o->width, o->height);
 		}
 	}
 
-	if (!strcmp(con_actions[info->connection], "connected"))
-		edid_desc(dpy, res, info->name, desc, sizeof(desc));
-
-	exec("display", info->name, con_actions[info->connection], desc);
+	notify(&(struct event) {
+		.type   = "display",
+		.device = info->name,
+		.status = con_actions[info->connection],
+		.name   = o ? o->model : "",
+		.screen = scr,
+		.output = o,
+	});
 done:
 	XRRFreeOutputInfo(info);
 	XRRFreeScreenResources(res);
 }
 
+/*
+ * CRTC reconfigured, e.g. a mode set by another tool.  The event has
+ * the new geometry, so the outputs driven by the CRTC are updated
+ * without asking the server.
+ */
+static void crtc_event(Display *dpy, int scr, XRRCrtcChangeNotifyEvent *ev)
+{
+	char *status = ev->mode != None ? "enabled" : "disabled";
+	RROutput ids[MAX_OUTPUTS];
+	int i, num = 0;
+
+	for (i = 0; i < xd->num_outputs; i++) {
+		struct xplugd_output *o = &xd->outputs[i];
+
+		if (o->crtc != ev->crtc)
+			continue;
+
+		ids[num++] = o->id;
+		if (ev->mode == None) {
+			o->crtc = None;
+			o->x = o->y = o->width = o->height = 0;
+			o->mode     = None;
+			o->rotation = RR_Rotate_0;
+		} else {
+			o->x        = ev->x;
+			o->y        = ev->y;
+			o->width    = ev->width;
+			o->height   = ev->height;
+			o->mode     = ev->mode;
+			o->rotation = ev->rotation;
+		}
+	}
+
+	/* Newly enabled CRTC, the server has not told us its outputs yet */
+	if (!num && ev->mode != None) {
+		screen_refresh(dpy, scr, 0);
+		for (i = 0; i < xd->num_outputs; i++) {
+			if (xd->outputs[i].crtc == ev->crtc)
+				ids[num++] = xd->outputs[i].id;
+		}
+	}
+
+	/* Callbacks may refresh the topology, so look up each output again */
+	for (i = 0; i < num; i++)
+		output_notify("crtc", ids[i], status, NULL, scr);
+}
+
+static int wants(const char *type)
+{
+	return conf_wants(type) || sock_wants(type);
+}
+
+static void property_event(Display *dpy, int scr, XRROutputPropertyNotifyEvent *ev)
+{
+	char prop[64] = "";
+	char *name;
+
+	if (ev->property == xd->link_atom && ev->state == PropertyNewValue && conf_retrain())
+		link_event(dpy, scr, ev->output);
+	if (ev->property == xd->edid_atom)
+		output_reload(dpy, scr, ev->output);
+
+	/* Also selected for link-status, with retrain */
+	if (!wants("property"))
+		return;
+
+	name = XGetAtomName(dpy, ev->property);
+	if (name) {
+		snprintf(prop, sizeof(prop), "%s", name);
+		XFree(name);
+	}
+
+	output_notify("property", ev->output, ev->state == PropertyNewValue ? "changed" : "deleted", prop, scr);
+}
+
+/*
+ * Pair providers as configured, see prime.c.  The outputs of a new sink
+ * are then probed once, and the connected ones announced right away.
+ */
+static void providers(Display *dpy, int scr)
+{
+	RROutput known[MAX_OUTPUTS], ids[MAX_OUTPUTS];
+	int i, j, num_known = 0, num = 0;
+
+	if (!prime_apply(dpy, scr))
+		return;
+
+	for (i = 0; i < xd->num_outputs; i++)
+		known[num_known++] = xd->outputs[i].id;
+
+	screen_refresh(dpy, scr, 1);
+
+	for (i = 0; i < xd->num_outputs; i++) {
+		struct xplugd_output *o = &xd->outputs[i];
+
+		if (o->screen != scr || o->connection != RR_Connected)
+			continue;
+		for (j = 0; j < num_known; j++) {
+			if (known[j] == o->id)
+				break;
+		}
+		if (j < num_known)
+			continue;
+
+		ids[num++] = o->id;
+		if (xd->num_primed < MAX_OUTPUTS)
+			xd->primed[xd->num_primed++] = o->id;
+	}
+
+	/* Callbacks may refresh the topology, so look up each output again */
+	for (i = 0; i < num; i++)
+		output_notify("display", ids[i], "connected", NULL, scr);
+}
+
+/*
+ * Pair providers on all screens, when the display is opened.  No events
+ * for the outputs, they are already there.
+ */
+int randr_providers(Display *dpy)
+{
+	int scr, num = 0;
+
+	for (scr = 0; scr < xd->num_screens; scr++) {
+		if (prime_apply(dpy, scr) > 0 && !screen_refresh(dpy, scr, 1))
+			num++;
+	}
+
+	return num;
+}
+
+/*
+ * GPU provider changed role, e.g. set up for PRIME.  The description is
+ * the new role, a list of its capabilities in use.
+ */
+static void provider_event(Display *dpy, int scr, XRRProviderChangeNotifyEvent *ev)
+{
+	static const struct {
+		unsigned int cap;
+		const char  *name;
+	} roles[] = {
+		{ RR_Capability_SourceOutput,  "source-output"  },
+		{ RR_Capability_SinkOutput,    "sink-output"    },
+		{ RR_Capability_SourceOffload, "source-offload" },
+		{ RR_Capability_SinkOffload,   "sink-offload"   },
+	};
+	char device[20], role[80] = "";
+	size_t i, len = 0;
+
+	/* Also selected for provider pairing */
+	providers(dpy, scr);
+	if (!wants("provider"))
+		return;
+
+	for (i = 0; i < sizeof(roles) / sizeof(roles[0]) && len < sizeof(role); i++) {
+		if (ev->current_role & roles[i].cap)
+			len += snprintf(&role[len], sizeof(role) - len, "%s%s", len ? "," : "", roles[i].name);
+	}
+	snprintf(device, sizeof(device), "0x%lx", ev->provider);
+
+	notify(&(struct event) {
+		.type   = "provider",
+		.device = device,
+		.status = "changed",
+		.name   = role,
+		.screen = scr,
+	});
+}
+
+/*
+ * Outputs, CRTCs, or modes were added or removed, e.g. a USB display
+ * adapter, refresh the whole screen.  A new provider is only seen here,
+ * RandR has no event for it.
+ */
+static void resource_event(Display *dpy, int scr)
+{
+	char device[12];
+
+	providers(dpy, scr);
+	screen_refresh(dpy, scr, 0);
+	if (!wants("resource"))
+		return;
+
+	snprintf(device, sizeof(device), "%d", scr);
+
+	notify(&(struct event) {
+		.type   = "resource",
+		.device = device,
+		.status = "changed",
+		.screen = scr,
+	});
+}
+
+/*
+ * Screen size, rotation, or RandR 1.5 monitors changed
+ */
+static void screen_event(Display *dpy, XRRScreenChangeNotifyEvent *ev)
+{
+	char device[12], size[32];
+	int scr;
+
+	/* Keep Xlib's DisplayWidth() et al. up to date */
+	XRRUpdateConfiguration((XEvent *)ev);
+
+	scr = screen_of(ev->root);
+	if (scr < 0)
+		return;
+	xd->screen = scr;
+
+	snprintf(device, sizeof(device), "%d", scr);
+	snprintf(size, sizeof(size), "%dx%d", ev->width, ev->height);
+
+	notify(&(struct event) {
+		.type   = "screen",
+		.device = device,
+		.status = "changed",
+		.name   = size,
+		.screen = scr,
+	});
+}
+
+/*
+ * RandR events besides output changes, selected only when a rule or a
+ * subscriber names the event type
+ */
+static const struct {
+	const char *type;
+	int         mask;
+	int         version;		/* RandR version required */
+} masks[] = {
+	{ "crtc",     RRCrtcChangeNotifyMask,     102 },
+	{ "property", RROutputPropertyNotifyMask, 102 },
+	{ "provider", RRProviderChangeNotifyMask, 104 },
+	{ "resource", RRResourceChangeNotifyMask, 104 },
+	{ "screen",   RRScreenChangeNotifyMask,   102 },
+};
+
+/*
+ * Select the RandR events wanted on all screens.  Output changes are
+ * always needed, the rest would only cause wakeups if nobody wants
+ * them.  Called again when rules or subscriptions change.
+ */
+int randr_select(Display *dpy)
+{
+	int mask = RROutputChangeNotifyMask;
+	size_t i;
+	int scr, num;
+
+	for (i = 0; i < sizeof(masks) / sizeof(masks[0]); i++) {
+		if (xd->rr_version < masks[i].version)
+			continue;
+		if (wants(masks[i].type))
+			mask |= masks[i].mask;
+	}
+
+	/* Bad DisplayPort links are retrained, if asked to, see link.c */
+	if (xd->link_atom != None && conf_retrain())
+		mask |= RROutputPropertyNotifyMask;
+
+	/* New providers are paired, see prime.c */
+	conf_prime(&num);
+	if (num && xd->rr_version >= 104)
+		mask |= RRProviderChangeNotifyMask | RRResourceChangeNotifyMask;
+
+	if (mask == xd->rr_mask)
+		return 0;
+
+	syslog(LOG_DEBUG, "Selecting RandR events 0x%x on %s", mask, xd->name);
+	for (scr = 0; scr < xd->num_screens; scr++)
+		XRRSelectInput(dpy, xd->screens[scr].root, mask);
+	xd->rr_mask = mask;
+
+	return 0;
+}
+
 int randr_init(Display *dpy)
 {
-	XRRSelectInput(dpy, DefaultRootWindow(dpy), RROutputChangeNotifyMask);
+	int major = 0, minor = 0, error_base;
+
+	if (!XRRQueryExtension(dpy, &xd->rr_event_base, &error_base) ||
+	    !XRRQueryVersion(dpy, &major, &minor)) {
+		syslog(LOG_ERR, "RandR extension not available on %s", xd->name);
+		return -1;
+	}
+	xd->rr_version = major * 100 + minor;
+	xd->rr_mask    = 0;
+
+	xd->edid_atom = XInternAtom(dpy, RR_PROPERTY_RANDR_EDID, True);
+	xd->connector_atom = XInternAtom(dpy, "CONNECTOR_ID", True);
+	xd->link_atom = XInternAtom(dpy, "link-status", True);
+	xd->link_bad  = XInternAtom(dpy, "Bad", True);
+	randr_select(dpy);
+	randr_refresh(dpy, 0);
+
 	return 0;
 }
 
 int randr_event(Display *dpy, XEvent *ev)
 {
-	handle_event(dpy, (XRROutputChangeNotifyEvent *)ev);
+	XRRNotifyEvent *rn = (XRRNotifyEvent *)ev;
+	int scr;
+
+	switch (ev->type - xd->rr_event_base) {
+	case RRScreenChangeNotify:
+		screen_event(dpy, (XRRScreenChangeNotifyEvent *)ev);
+		return 0;
+
+	case RRNotify:
+		break;
+
+	default:
+		return -1;	/* Not a RandR event */
+	}
+
+	scr = screen_of(rn->window);
+	if (scr < 0) {
+		syslog(LOG_DEBUG, "Event for unknown root window 0x%lx, skipping", rn->window);
+		return 0;
+	}
+	xd->screen = scr;
+
+	switch (rn->subtype) {
+	case RRNotify_OutputChange:
+		output_event(dpy, scr, (XRROutputChangeNotifyEvent *)ev);
+		break;
+
+	case RRNotify_CrtcChange:
+		crtc_event(dpy, scr, (XRRCrtcChangeNotifyEvent *)ev);
+		break;
+
+	case RRNotify_OutputProperty:
+		property_event(dpy, scr, (XRROutputPropertyNotifyEvent *)ev);
+		break;
+
+	case RRNotify_ProviderChange:
+		provider_event(dpy, scr, (XRRProviderChangeNotifyEvent *)ev);
+		break;
+
+	case RRNotify_ResourceChange:
+		resource_event(dpy, scr);
+		break;
+	}
+
 	return 0;
 }
 
@@ -176,77 +869,91 @@ int randr_event(Display *dpy, XEvent *ev)
 #define PRINT_INT(val)   if (val > 0)   printf("%d\n", val); else printf("%s\n", NA)
 #define PRINT_FLOAT(val) if (val > 0.0) printf("%G\n", val); else printf("%s\n", NA)
 
-int randr_probe(Display *dpy)
+static int probe(Display *dpy, Atom edid_atom, Atom connector_atom, int local, int scr)
 {
 	struct monitor_info *info;
 	XRRScreenResources *res;
-	Window root;
-	Atom *p;
 	int i;
 
-	root = RootWindow(dpy, DefaultScreen(dpy));
-	res = XRRGetScreenResources(dpy, root);
+	res = XRRGetScreenResources(dpy, RootWindow(dpy, scr));
 	if (!res)
 		return 1;
 
 	for (i = 0; i < res->noutput; ++i) {
 		XRROutputInfo *output_info;
-		int j, np;
+		uint64_t hash;
 
 		output_info = XRRGetOutputInfo(dpy, res, res->outputs[i]);
 		if (!output_info)
 			continue;
 
-		if (output_info->connection != RR_Connected)
+		if (output_info->connection != RR_Connected) {
+			XRRFreeOutputInfo(output_info);
 			continue;
+		}
 
-		p = XRRListOutputProperties(dpy, res->outputs[i], &np);
-		for (j = 0; j < np; ++j) {
-			if (strcmp(XGetAtomName(dpy, p[j]), "EDID"))
-				continue;
-
-			info = edid_info(dpy, res->outputs[i], p[j]);
-			if (!info) {
-				printf("No EDID info for output %s\n", output_info->name);
-				break;
-			}
+		info = edid_info(dpy, edid_atom, connector_atom, local, res->outputs[i], output_info->name, &hash);
+		if (!info) {
+			printf("No EDID info for output %s\n", output_info->name);
+			XRRFreeOutputInfo(output_info);
+			continue;
+		}
 
+		if (ScreenCount(dpy) > 1)
+			printf("%s (screen %d)\n", output_info->name, scr);
+		else
 			printf("%s\n", output_info->name);
-			printf("   Model          : "); PRINT_STR(info->dsc_product_name);
-			printf("   Serial Nr.     : "); PRINT_STR(info->dsc_serial_number);
-			printf("   Width          : "); PRINT_INT(info->width_mm);
-			printf("   Height         : "); PRINT_INT(info->height_mm);
-			printf("   Aspect Ratio   : "); PRINT_FLOAT(info->aspect_ratio);
-			printf("   Gamma          : "); PRINT_FLOAT(info->gamma);
-			printf("   Prod. Year     : "); PRINT_INT(info->production_year);
-			printf("   Prod. Week     : "); PRINT_INT(info->production_week);
-			printf("   Model Year     : "); PRINT_INT(info->model_year);
-			printf("   Extra          : "); PRINT_STR(info->dsc_string);
-
-			printf("   DPMS\n");
-			printf("      Standby     : "); PRINT_BOOL(info->standby);
-			printf("      Suspend     : "); PRINT_BOOL(info->suspend);
-			printf("      Active Off  : "); PRINT_BOOL(info->active_off);
-
-			if (info->is_digital) {
-				printf("   Interface      : "); PRINT_STR(iface_type_names[info->digital.interface]);
-				printf("   Display Type   : (digital)\n");
-				printf("      RGB 4:4:4   : "); PRINT_BOOL(info->digital.rgb444);
-				printf("      YCrCb 4:4:4 : "); PRINT_BOOL(info->digital.ycrcb444);
-				printf("      YCrCb 4:2:2 : "); PRINT_BOOL(info->digital.ycrcb422);
-			} else {
-				printf("    Display Type  : (analog)\n");
-				printf("                  : "); PRINT_STR(color_type_names[info->analog.color_type]);
-			}
-
-			printf("   EDID Version   : %d.%d\n", info->major_version, info->minor_version);
-			break;
+		printf("   Model          : "); PRINT_STR(info->dsc_product_name);
+		printf("   Serial Nr.     : "); PRINT_STR(info->dsc_serial_number);
+		printf("   Width          : "); PRINT_INT(info->width_mm);
+		printf("   Height         : "); PRINT_INT(info->height_mm);
+		printf("   Aspect Ratio   : "); PRINT_FLOAT(info->aspect_ratio);
+		printf("   Gamma          : "); PRINT_FLOAT(info->gamma);
+		printf("   Prod. Year     : "); PRINT_INT(info->production_year);
+		printf("   Prod. Week     : "); PRINT_INT(info->production_week);
+		printf("   Model Year     : "); PRINT_INT(info->model_year);
+		printf("   Extra          : "); PRINT_STR(info->dsc_string);
+
+		printf("   DPMS\n");
+		printf("      Standby     : "); PRINT_BOOL(info->standby);
+		printf("      Suspend     : "); PRINT_BOOL(info->suspend);
+		printf("      Active Off  : "); PRINT_BOOL(info->active_off);
+
+		if (info->is_digital) {
+			printf("   Interface      : "); PRINT_STR(iface_type_names[info->digital.interface]);
+			printf("   Display Type   : (digital)\n");
+			printf("      RGB 4:4:4   : "); PRINT_BOOL(info->digital.rgb444);
+			printf("      YCrCb 4:4:4 : "); PRINT_BOOL(info->digital.ycrcb444);
+			printf("      YCrCb 4:2:2 : "); PRINT_BOOL(info->digital.ycrcb422);
+		} else {
+			printf("    Display Type  : (analog)\n");
+			printf("                  : "); PRINT_STR(color_type_names[info->analog.color_type]);
 		}
+
+		printf("   EDID Version   : %d.%d\n", info->major_version, info->minor_version);
+		printf("   EDID Hash      : %016" PRIx64 "\n", hash);
+		XRRFreeOutputInfo(output_info);
 	}
+	XRRFreeScreenResources(res);
 
 	return 0;
 }
 
+int randr_probe(Display *dpy)
+{
+	Atom edid_atom, connector_atom;
+	int scr, local, rc = 0;
+
+	/* No display_add() for -p, so no xd, everything is passed on */
+	edid_atom      = XInternAtom(dpy, RR_PROPERTY_RANDR_EDID, True);
+	connector_atom = XInternAtom(dpy, "CONNECTOR_ID", True);
+	local          = display_local(dpy);
+	for (scr = 0; scr < ScreenCount(dpy); scr++)
+		rc |= probe(dpy, edid_atom, connector_atom, local, scr);
+
+	return rc;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
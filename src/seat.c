@@ -0,0 +1,226 @@
+/* Multi-seat input routing, attach devices to the master of their seat
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The seat action attaches an input device to the master pointer, or
+ * keyboard, of a seat, like `xinput reattach`.  Masters are named the
+ * way XIAddMaster names them, "NAME pointer" and "NAME keyboard", and
+ * are created the first time a device is assigned to the seat:
+ *
+ *    keyboard connected * usb=046d:c31c                   seat seat1
+ *    pointer  connected * node=/dev/input/event1[0-9]     seat seat2
+ *
+ * "Virtual core" is the default seat, "none" floats the device, i.e.,
+ * detaches it from any master.
+ *
+ * Devices are only queued when the rule matches.  Once the hierarchy
+ * event is handled all missing masters are created in one request,
+ * and all devices are attached, or detached, in one more.
+ */
+
+#include "xplugd.h"
+
+#define SEAT_NONE "none"
+
+struct assign {
+	int           id;
+	int           use;		/* XISlavePointer or XISlaveKeyboard */
+	const char   *seat;		/* Rule argument */
+};
+
+static struct assign queue[MAX_DEVICES];
+static int num_queued;
+
+int seat_init(Display *dpy, struct rule *r)
+{
+	/* Master names are "NAME keyboard", and must fit device names */
+	if (r->argc != 1 || !r->argv[0][0] || strlen(r->argv[0]) > SEAT_NAME_LEN)
+		return -1;
+
+	return 0;
+}
+
+int seat_run(Display *dpy, struct rule *r, struct event *ev)
+{
+	struct xplugd_device *dev;
+	int i;
+
+	if (!ev->input || strcmp(ev->status, "connected")) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	dev = input_device(atoi(ev->device));
+	if (!dev) {
+		errno = ENODEV;
+		return -1;
+	}
+
+	/* Last matching rule wins */
+	for (i = 0; i < num_queued; i++) {
+		if (queue[i].id == dev->id)
+			break;
+	}
+	if (i == num_queued) {
+		if (num_queued >= MAX_DEVICES) {
+			errno = ENOSPC;
+			return -1;
+		}
+		num_queued++;
+	}
+
+	queue[i].id   = dev->id;
+	queue[i].use  = !strcmp(ev->type, "keyboard") ? XISlaveKeyboard : XISlavePointer;
+	queue[i].seat = r->argv[0];
+
+	return 0;
+}
+
+static XIDeviceInfo *find(XIDeviceInfo *info, int num, int id)
+{
+	for (int i = 0; i < num; i++) {
+		if (info[i].deviceid == id)
+			return &info[i];
+	}
+
+	return NULL;
+}
+
+/* Master of @seat for a slave of type @use, or NULL */
+static XIDeviceInfo *master(XIDeviceInfo *info, int num, const char *seat, int use)
+{
+	char name[SEAT_NAME_LEN + 16];
+
+	snprintf(name, sizeof(name), "%s %s", seat, use == XISlaveKeyboard ? "keyboard" : "pointer");
+	for (int i = 0; i < num; i++) {
+		if (info[i].use != XIMasterPointer && info[i].use != XIMasterKeyboard)
+			continue;
+		if (!strcmp(info[i].name, name))
+			return &info[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Create the masters of all seats that do not exist yet, in one request.
+ * Returns the number of masters requested.
+ */
+static int add_masters(Display *dpy, XIDeviceInfo *info, int num)
+{
+	XIAnyHierarchyChangeInfo change[MAX_DEVICES];
+	int i, j, n = 0;
+
+	for (i = 0; i < num_queued; i++) {
+		struct assign *a = &queue[i];
+
+		if (!strcmp(a->seat, SEAT_NONE) || master(info, num, a->seat, a->use))
+			continue;
+		for (j = 0; j < n; j++) {
+			if (!strcmp(change[j].add.name, a->seat))
+				break;
+		}
+		if (j < n)
+			continue;
+
+		syslog(LOG_NOTICE, "Creating seat %s on %s", a->seat, xd->name);
+		change[n].add.type      = XIAddMaster;
+		change[n].add.name      = (char *)a->seat;
+		change[n].add.send_core = True;
+		change[n].add.enable    = True;
+		n++;
+	}
+
+	if (n && XIChangeHierarchy(dpy, change, n) != Success)
+		return -1;
+
+	return n;
+}
+
+/*
+ * Apply all seat assignments queued while handling an event
+ */
+void seat_flush(Display *dpy)
+{
+	XIAnyHierarchyChangeInfo change[MAX_DEVICES];
+	XIDeviceInfo *info;
+	int i, num, n = 0;
+
+	if (!num_queued)
+		return;
+
+	info = XIQueryDevice(dpy, XIAllDevices, &num);
+	if (!info)
+		goto done;
+
+	if (add_masters(dpy, info, num) > 0) {
+		XIFreeDeviceInfo(info);
+		info = XIQueryDevice(dpy, XIAllDevices, &num);
+		if (!info)
+			goto done;
+	}
+
+	for (i = 0; i < num_queued; i++) {
+		struct assign *a = &queue[i];
+		XIDeviceInfo *dev, *m = NULL;
+
+		dev = find(info, num, a->id);
+		if (!dev)
+			continue;
+
+		if (strcmp(a->seat, SEAT_NONE)) {
+			m = master(info, num, a->seat, a->use);
+			if (!m) {
+				syslog(LOG_WARNING, "No seat %s for device %d %s", a->seat, a->id, dev->name);
+				continue;
+			}
+			if (dev->use != XIFloatingSlave && dev->attachment == m->deviceid)
+				continue;
+
+			change[n].attach.type       = XIAttachSlave;
+			change[n].attach.deviceid   = a->id;
+			change[n].attach.new_master = m->deviceid;
+		} else {
+			if (dev->use == XIFloatingSlave)
+				continue;
+
+			change[n].detach.type     = XIDetachSlave;
+			change[n].detach.deviceid = a->id;
+		}
+
+		syslog(LOG_INFO, "Device %d %s to seat %s", a->id, dev->name, a->seat);
+		n++;
+	}
+	XIFreeDeviceInfo(info);
+
+	if (n && XIChangeHierarchy(dpy, change, n) != Success)
+		syslog(LOG_WARNING, "Failed assigning %d devices to seats on %s", n, xd->name);
+done:
+	num_queued = 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,342 @@
+/* Publish topology snapshot in shared memory for external readers
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The snapshot file outlives the daemon, so it is also the state to
+ * pick up from when restarted, e.g. after a crash or an upgrade.  The
+ * topology read at start is compared with the file before it is
+ * overwritten, and only the outputs and devices that changed while we
+ * were gone are sent as events.  The file records the PID of the X
+ * server, a new server, e.g. a new session, starts from nothing.
+ */
+
+#define _GNU_SOURCE			/* struct ucred */
+#include <time.h>
+#include <sys/socket.h>
+#include "xplugd.h"
+#include "snapshot.h"
+
+/* Topology at start, events may refresh the caches while reconciling */
+static struct xplugd_output outputs[MAX_OUTPUTS];
+static struct xplugd_device devices[MAX_DEVICES];
+static struct snapshot prev;
+
+static char *path(char *buf, size_t len)
+{
+	if (multi)
+		return snapshot_display_path(buf, len, xd->name);
+
+	return snapshot_path(buf, len);
+}
+
+/*
+ * Create, or reuse, the snapshot file of the current display
+ */
+int snapshot_init(void)
+{
+	struct snapshot *shm;
+	char file[256];
+	int fd;
+
+	if (!path(file, sizeof(file))) {
+		syslog(LOG_NOTICE, "XDG_RUNTIME_DIR not set, not publishing topology snapshot");
+		return -1;
+	}
+
+	fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		goto fail;
+
+	if (ftruncate(fd, sizeof(*shm))) {
+		close(fd);
+		goto fail;
+	}
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		shm = NULL;
+		goto fail;
+	}
+
+	/* Readers may already have it mapped, keep the seqlock protocol */
+	if (shm->magic != SNAPSHOT_MAGIC || shm->version != SNAPSHOT_VERSION || (shm->seq & 1)) {
+		memset(shm, 0, sizeof(*shm));
+		shm->version = SNAPSHOT_VERSION;
+		shm->magic   = SNAPSHOT_MAGIC;
+	}
+	xd->shm = shm;
+
+	return 0;
+fail:
+	syslog(LOG_ERR, "Failed creating topology snapshot %s: %s", file, strerror(errno));
+	return -1;
+}
+
+/*
+ * Display is gone, readers of a per-display file should not find it
+ */
+void snapshot_exit(void)
+{
+	char file[256];
+
+	if (!xd->shm)
+		return;
+
+	munmap(xd->shm, sizeof(*xd->shm));
+	xd->shm = NULL;
+
+	if (multi && path(file, sizeof(file)))
+		unlink(file);
+}
+
+/*
+ * PID of the X server, for local connections, otherwise 0
+ */
+static uint32_t server_pid(void)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(ConnectionNumber(xd->dpy), SOL_SOCKET, SO_PEERCRED, &cred, &len) || cred.pid < 0)
+		return 0;
+
+	return cred.pid;
+}
+
+static const struct snapshot_output *prev_output(const struct xplugd_output *o)
+{
+	for (uint32_t i = 0; i < prev.num_outputs; i++) {
+		const struct snapshot_output *so = &prev.outputs[i];
+
+		if (so->screen == o->screen && !strcmp(so->name, o->name))
+			return so;
+	}
+
+	return NULL;
+}
+
+static const struct snapshot_device *prev_device(const struct xplugd_device *d)
+{
+	for (uint32_t i = 0; i < prev.num_devices; i++) {
+		const struct snapshot_device *sd = &prev.devices[i];
+
+		if (sd->id == d->id && sd->use == (uint32_t)d->use && !strcmp(sd->name, d->name))
+			return sd;
+	}
+
+	return NULL;
+}
+
+static void device_notify(int id, int use, char *status, char *name)
+{
+	char device[12];
+
+	if (use != XISlavePointer && use != XISlaveKeyboard)
+		return;
+
+	snprintf(device, sizeof(device), "%d", id);
+	xd->screen = DefaultScreen(xd->dpy);
+	notify(&(struct event) {
+		.type   = use == XISlavePointer ? "pointer" : "keyboard",
+		.device = device,
+		.status = status,
+		.name   = name,
+		.screen = DefaultScreen(xd->dpy),
+		.input  = 1,
+	});
+}
+
+/*
+ * Send events for what changed since the snapshot was last written,
+ * must be called after snapshot_init() and before snapshot_update().
+ * Removed and disabled things first, so scripts handling the rest see
+ * the topology as it is now.
+ */
+void snapshot_reconcile(void)
+{
+	struct snapshot *shm = xd->shm;
+	int i, num_outputs, num_devices;
+	struct xplugd_output *cur_outputs;
+	struct xplugd_device *cur_devices;
+	uint32_t j;
+
+	if (!shm)
+		return;
+
+	memcpy(&prev, shm, sizeof(prev));
+	if (prev.server != server_pid()) {
+		prev.num_outputs = 0;
+		prev.num_devices = 0;
+	}
+	if (prev.num_outputs > SNAPSHOT_MAX_OUTPUTS)
+		prev.num_outputs = SNAPSHOT_MAX_OUTPUTS;
+	if (prev.num_devices > SNAPSHOT_MAX_DEVICES)
+		prev.num_devices = SNAPSHOT_MAX_DEVICES;
+
+	/* Arguments are evaluated in any order, get the counts first */
+	cur_outputs = randr_outputs(&num_outputs);
+	memcpy(outputs, cur_outputs, num_outputs * sizeof(*outputs));
+	cur_devices = input_devices(&num_devices);
+	memcpy(devices, cur_devices, num_devices * sizeof(*devices));
+
+	for (j = 0; j < prev.num_outputs; j++) {
+		struct snapshot_output *so = &prev.outputs[j];
+
+		if (so->connection != SNAPSHOT_CONNECTED)
+			continue;
+		for (i = 0; i < num_outputs; i++) {
+			if (outputs[i].screen == so->screen && !strcmp(outputs[i].name, so->name))
+				break;
+		}
+		if (i < num_outputs && outputs[i].connection == RR_Connected)
+			continue;
+
+		xd->screen = so->screen;
+		notify(&(struct event) {
+			.type   = "display",
+			.device = so->name,
+			.status = "disconnected",
+			.name   = so->model,
+			.screen = so->screen,
+		});
+	}
+
+	for (j = 0; j < prev.num_devices; j++) {
+		struct snapshot_device *sd = &prev.devices[j];
+
+		if (!sd->enabled)
+			continue;
+		for (i = 0; i < num_devices; i++) {
+			if (devices[i].id == sd->id && !strcmp(devices[i].name, sd->name))
+				break;
+		}
+		if (i < num_devices && devices[i].enabled)
+			continue;
+
+		device_notify(sd->id, sd->use, "disconnected", sd->name);
+	}
+
+	for (i = 0; i < num_outputs; i++) {
+		const struct snapshot_output *so = prev_output(&outputs[i]);
+		struct xplugd_output *o = &outputs[i];
+
+		if (o->connection != RR_Connected)
+			continue;
+		if (so && so->connection == SNAPSHOT_CONNECTED && so->edid_hash == o->edid_hash)
+			continue;
+
+		xd->screen = o->screen;
+		notify(&(struct event) {
+			.type   = "display",
+			.device = o->name,
+			.status = "connected",
+			.name   = o->model,
+			.screen = o->screen,
+			.output = o,
+		});
+	}
+
+	for (i = 0; i < num_devices; i++) {
+		const struct snapshot_device *sd = prev_device(&devices[i]);
+
+		if (!devices[i].enabled || (sd && sd->enabled))
+			continue;
+
+		device_notify(devices[i].id, devices[i].use, "connected", devices[i].name);
+	}
+	seat_flush(xd->dpy);
+}
+
+/*
+ * Copy cached topology to the shared snapshot, called after each event
+ */
+void snapshot_update(void)
+{
+	struct snapshot *shm = xd->shm;
+	struct xplugd_output *outputs;
+	struct xplugd_device *devices;
+	struct timespec ts;
+	int i, num;
+	uint32_t seq;
+
+	if (!shm)
+		return;
+
+	seq = shm->seq + 1;
+	__atomic_store_n(&shm->seq, seq, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	outputs = randr_outputs(&num);
+	if (num > SNAPSHOT_MAX_OUTPUTS)
+		num = SNAPSHOT_MAX_OUTPUTS;
+	memset(shm->outputs, 0, sizeof(shm->outputs));
+	for (i = 0; i < num; i++) {
+		struct snapshot_output *so = &shm->outputs[i];
+		struct xplugd_output *o = &outputs[i];
+
+		snprintf(so->name, sizeof(so->name), "%s", o->name);
+		so->connection = o->connection;
+		so->x          = o->x;
+		so->y          = o->y;
+		so->width      = o->width;
+		so->height     = o->height;
+		so->rotation   = o->rotation;
+		so->mm_width   = o->mm_width;
+		so->mm_height  = o->mm_height;
+		so->edid_hash  = o->edid_hash;
+		so->product    = o->product;
+		so->serial     = o->serial;
+		so->screen     = o->screen;
+		memcpy(so->vendor, o->vendor, sizeof(so->vendor));
+		memcpy(so->model, o->model, sizeof(so->model));
+	}
+	shm->num_outputs = num;
+
+	devices = input_devices(&num);
+	if (num > SNAPSHOT_MAX_DEVICES)
+		num = SNAPSHOT_MAX_DEVICES;
+	memset(shm->devices, 0, sizeof(shm->devices));
+	for (i = 0; i < num; i++) {
+		struct snapshot_device *sd = &shm->devices[i];
+		struct xplugd_device *d = &devices[i];
+
+		sd->id      = d->id;
+		sd->use     = d->use;
+		sd->enabled = d->enabled;
+		snprintf(sd->name, sizeof(sd->name), "%s", d->name);
+	}
+	shm->num_devices = num;
+	shm->server      = server_pid();
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	shm->updated = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	__atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,221 @@
+/* xplugd topology snapshot, shared memory layout and reader
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * xplugd publishes the current outputs and input devices in a file,
+ * $XDG_RUNTIME_DIR/xplugd.snapshot, that readers mmap() once.  After
+ * that a consistent copy can be taken at any time without syscalls or
+ * X traffic.  The writer bumps the sequence counter to an odd value
+ * before, and to an even value after, each update (a seqlock), readers
+ * retry until they see the same even value before and after copying.
+ *
+ * A daemon watching several X displays publishes one file per display,
+ * $XDG_RUNTIME_DIR/xplugd-DISPLAY.snapshot, e.g. xplugd-:1.snapshot.
+ */
+
+#ifndef XPLUGD_SNAPSHOT_H_
+#define XPLUGD_SNAPSHOT_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_FILE        "xplugd.snapshot"
+#define SNAPSHOT_FILE_FMT    "xplugd-%s.snapshot"
+#define SNAPSHOT_MAGIC       0x58504c47	/* "XPLG" */
+#define SNAPSHOT_VERSION     2		/* 2: screen in snapshot_output */
+#define SNAPSHOT_MAX_OUTPUTS 32
+#define SNAPSHOT_MAX_DEVICES 64
+
+/* Same values as RandR RR_Connected et al. */
+#define SNAPSHOT_CONNECTED    0
+#define SNAPSHOT_DISCONNECTED 1
+#define SNAPSHOT_UNKNOWN      2
+
+struct snapshot_output {
+	char     name[32];
+	uint32_t connection;
+	int32_t  x, y;			/* CRTC geometry, 0x0 if disabled */
+	uint32_t width, height;
+	uint32_t rotation;
+	uint32_t mm_width, mm_height;
+
+	uint64_t edid_hash;		/* 0 if no EDID */
+	char     vendor[4];		/* EDID summary */
+	uint32_t product;
+	uint32_t serial;
+	char     model[14];
+	uint8_t  screen;		/* X screen, since version 2 */
+};
+
+struct snapshot_device {
+	int32_t  id;			/* XI2 device id */
+	uint32_t use;			/* XISlavePointer, XISlaveKeyboard, ... */
+	uint32_t enabled;
+	char     name[64];
+};
+
+struct snapshot {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;			/* Odd while being updated */
+	uint32_t num_outputs;
+	uint32_t num_devices;
+	uint32_t server;		/* X server PID, 0 if unknown */
+	uint64_t updated;		/* CLOCK_REALTIME, usec */
+
+	struct snapshot_output outputs[SNAPSHOT_MAX_OUTPUTS];
+	struct snapshot_device devices[SNAPSHOT_MAX_DEVICES];
+};
+
+/*
+ * Path to snapshot file, returns NULL if $XDG_RUNTIME_DIR is unset
+ */
+static inline char *snapshot_path(char *buf, size_t len)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	if (!dir)
+		return NULL;
+
+	snprintf(buf, len, "%s/%s", dir, SNAPSHOT_FILE);
+
+	return buf;
+}
+
+/*
+ * Path to snapshot file of one of many displays, e.g. ":1", all its
+ * screens share the file, so ":1.1" is the same
+ */
+static inline char *snapshot_display_path(char *buf, size_t len, const char *display)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	char name[64], *ptr;
+	size_t i;
+
+	if (!dir || !display)
+		return NULL;
+
+	snprintf(name, sizeof(name), "%s", display);
+	ptr = strrchr(name, ':');
+	if (ptr && (ptr = strchr(ptr, '.')))
+		*ptr = 0;
+	for (i = 0; name[i]; i++) {
+		if (name[i] == '/')
+			name[i] = '_';
+	}
+	snprintf(buf, len, "%s/" SNAPSHOT_FILE_FMT, dir, name);
+
+	return buf;
+}
+
+/*
+ * Map the snapshot file read-only, @path may be NULL for the default:
+ * the file of $DISPLAY if there is one, otherwise the single display
+ * file.  Returns NULL and sets errno on failure.
+ */
+static inline const struct snapshot *snapshot_open(const char *path)
+{
+	const struct snapshot *shm;
+	char buf[256];
+	struct stat st;
+	int fd;
+
+	if (!path) {
+		path = snapshot_display_path(buf, sizeof(buf), getenv("DISPLAY"));
+		if (!path || access(path, R_OK))
+			path = snapshot_path(buf, sizeof(buf));
+	}
+	if (!path) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*shm)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return NULL;
+
+	if (shm->magic != SNAPSHOT_MAGIC || shm->version != SNAPSHOT_VERSION) {
+		munmap((void *)shm, sizeof(*shm));
+		errno = EPROTO;
+		return NULL;
+	}
+
+	return shm;
+}
+
+static inline void snapshot_close(const struct snapshot *shm)
+{
+	if (shm)
+		munmap((void *)shm, sizeof(*shm));
+}
+
+/*
+ * Take a consistent copy of the snapshot, no syscalls involved.
+ * Returns 0 on success, or -1 with errno EAGAIN if the writer kept
+ * updating during all attempts.
+ */
+static inline int snapshot_read(const struct snapshot *shm, struct snapshot *copy)
+{
+	for (int i = 0; i < 1000; i++) {
+		uint32_t seq;
+
+		seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(copy, shm, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+#endif /* XPLUGD_SNAPSHOT_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
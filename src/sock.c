@@ -0,0 +1,436 @@
+/* Control socket, event subscriptions for multiple consumers
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Clients connect to a SOCK_SEQPACKET socket, each message is one
+ * frame, and send commands as text.  A subscription is set up with:
+ *
+ *    subscribe [TYPE [DEVICE-GLOB [STATUS]]]
+ *
+ * where any field can be "*", or omitted, to match everything.  Each
+ * matching event is then sent as one frame, fields separated by tabs:
+ *
+ *    TYPE DEVICE STATUS DESCRIPTION DISPLAY SCREEN
+ *
+ * The commands below act on the default screen of the first display,
+ * or the display, and optionally screen, selected by the client with:
+ *
+ *    display NAME[.SCREEN]
+ *
+ * A layout, see layout.c for the syntax, is applied with:
+ *
+ *    layout SPEC
+ *
+ * and the current layout is stored as the profile for the connected
+ * displays with:
+ *
+ *    save
+ *
+ * Each command is answered with an "ok" or "error<TAB>reason" frame.
+ * Frames that cannot be sent right away are queued, up to SOCK_QLEN
+ * per client, a client that falls further behind is disconnected.  The
+ * queue is part of the client slot, so a slow client does not cause any
+ * heap allocations, or fragmentation, in a daemon running for months.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <fnmatch.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "xplugd.h"
+
+struct client {
+	int   sd;
+	int   subscribed;
+	char  type[16];
+	char  glob[64];
+	char  status[16];
+	char  display[64];		/* Selected display, or empty */
+	int   screen;			/* Selected screen, or -1 */
+
+	/* Ring buffer of pending frames */
+	char  queue[SOCK_QLEN][SOCK_FRAME_LEN];
+	int   head, count;
+};
+
+static struct client clients[SOCK_MAX_CLIENTS];
+static char sockpath[108];
+static int  sock = -1;
+
+static struct client *client_find(int sd)
+{
+	for (int i = 0; i < SOCK_MAX_CLIENTS; i++) {
+		if (clients[i].sd == sd)
+			return &clients[i];
+	}
+
+	return NULL;
+}
+
+static void client_close(struct client *c)
+{
+	int subscribed = c->subscribed;
+
+	loop_del(c->sd);
+	close(c->sd);
+
+	memset(c, 0, offsetof(struct client, queue));
+	c->head = c->count = 0;
+	c->sd   = -1;
+
+	if (subscribed)
+		display_reselect();
+}
+
+/*
+ * Send as many queued frames as possible, returns -1 if the client
+ * has gone away and was closed.
+ */
+static int client_flush(struct client *c)
+{
+	while (c->count > 0) {
+		char *frame = c->queue[c->head];
+
+		if (send(c->sd, frame, strlen(frame), MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			client_close(c);
+			return -1;
+		}
+
+		c->head = (c->head + 1) % SOCK_QLEN;
+		c->count--;
+	}
+
+	loop_output(c->sd, c->count > 0);
+
+	return 0;
+}
+
+static void client_send(struct client *c, const char *frame)
+{
+	if (c->count == 0) {
+		if (send(c->sd, frame, strlen(frame), MSG_DONTWAIT | MSG_NOSIGNAL) != -1)
+			return;
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			client_close(c);
+			return;
+		}
+	}
+
+	if (c->count >= SOCK_QLEN) {
+		syslog(LOG_NOTICE, "Dropping slow client on %s", sockpath);
+		client_close(c);
+		return;
+	}
+
+	snprintf(c->queue[(c->head + c->count) % SOCK_QLEN], SOCK_FRAME_LEN, "%s", frame);
+	c->count++;
+	loop_output(c->sd, 1);
+}
+
+static void reply(struct client *c, const char *fmt, ...)
+{
+	char buf[SOCK_FRAME_LEN];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	client_send(c, buf);
+}
+
+static void field(char *dst, size_t len, char *arg)
+{
+	snprintf(dst, len, "%s", arg ? arg : "*");
+}
+
+static int cmd_subscribe(struct client *c, char *args)
+{
+	char *save = NULL;
+
+	field(c->type,   sizeof(c->type),   strtok_r(args, " \t", &save));
+	field(c->glob,   sizeof(c->glob),   strtok_r(NULL, " \t", &save));
+	field(c->status, sizeof(c->status), strtok_r(NULL, " \t", &save));
+	c->subscribed = 1;
+	display_reselect();
+
+	return 0;
+}
+
+/*
+ * Make the client's display the current one, for the commands below
+ */
+static int select_display(struct client *c)
+{
+	struct xdisplay *d;
+
+	d = display_lookup(c->display);
+	if (!d) {
+		errno = ENODEV;
+		return -1;
+	}
+	xd = d;
+	xd->screen = c->screen < 0 ? DefaultScreen(d->dpy) : c->screen;
+
+	return 0;
+}
+
+static int cmd_display(struct client *c, char *args)
+{
+	struct xdisplay *d;
+	char *colon, *dot;
+	int scr = -1;
+
+	d = display_lookup(args);
+	if (!d) {
+		/* Screen of a watched display, NAME.SCREEN */
+		colon = strrchr(args, ':');
+		dot   = colon ? strchr(colon, '.') : NULL;
+		if (!dot) {
+			errno = ENODEV;
+			return -1;
+		}
+
+		*dot = 0;
+		scr  = atoi(&dot[1]);
+		d    = display_lookup(args);
+		if (!d || scr < 0 || scr >= d->num_screens) {
+			errno = ENODEV;
+			return -1;
+		}
+	}
+	snprintf(c->display, sizeof(c->display), "%s", d->name);
+	c->screen = scr;
+
+	return 0;
+}
+
+static int cmd_layout(struct client *c, char *args)
+{
+	struct layout l;
+
+	if (layout_parse(args, &l))
+		return -1;
+
+	if (!l.num) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (select_display(c))
+		return -1;
+
+	return layout_apply(xd->dpy, xd->screen, &l);
+}
+
+static int cmd_save(struct client *c, char *args)
+{
+	if (select_display(c))
+		return -1;
+
+	return profile_save();
+}
+
+static struct {
+	const char *name;
+	int       (*cb)(struct client *, char *);
+} commands[] = {
+	{ "subscribe", cmd_subscribe },
+	{ "display",   cmd_display   },
+	{ "layout",    cmd_layout    },
+	{ "save",      cmd_save      },
+	{ NULL, NULL }
+};
+
+static void client_command(struct client *c, char *buf)
+{
+	char *args;
+	int i;
+
+	buf[strcspn(buf, "\r\n")] = 0;
+	args = strpbrk(buf, " \t");
+	if (args)
+		*args++ = 0;
+	else
+		args = "";
+
+	for (i = 0; commands[i].name; i++) {
+		if (strcmp(commands[i].name, buf))
+			continue;
+
+		if (commands[i].cb(c, args))
+			reply(c, "error\t%s", strerror(errno));
+		else
+			reply(c, "ok");
+		return;
+	}
+
+	reply(c, "error\tunknown command %s", buf);
+}
+
+static void client_read(int sd, void *arg)
+{
+	struct client *c = client_find(sd);
+	char buf[SOCK_FRAME_LEN];
+	ssize_t len;
+
+	if (!c)
+		return;
+
+	if (c->count > 0 && client_flush(c))
+		return;
+
+	len = recv(sd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+	if (len == -1) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			client_close(c);
+		return;
+	}
+	if (len == 0) {
+		client_close(c);
+		return;
+	}
+	buf[len] = 0;
+
+	client_command(c, buf);
+}
+
+static void sock_accept(int sd, void *arg)
+{
+	struct client *c;
+	int client;
+
+	client = accept(sd, NULL, NULL);
+	if (client == -1)
+		return;
+
+	fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+	fcntl(client, F_SETFD, FD_CLOEXEC);
+
+	c = client_find(-1);
+	if (!c || loop_add(client, client_read, NULL)) {
+		syslog(LOG_WARNING, "Too many clients on %s", sockpath);
+		close(client);
+		return;
+	}
+
+	memset(c, 0, sizeof(*c));
+	c->sd     = client;
+	c->screen = -1;
+}
+
+static int match(const char *filter, const char *value)
+{
+	if (!strcmp(filter, "*"))
+		return 1;
+
+	return !fnmatch(filter, value ? value : "", 0);
+}
+
+/*
+ * Fan out event to all subscribed clients with a matching filter
+ */
+void sock_notify(struct event *ev)
+{
+	char frame[SOCK_FRAME_LEN];
+	int i, len = 0;
+
+	for (i = 0; i < SOCK_MAX_CLIENTS; i++) {
+		struct client *c = &clients[i];
+
+		if (c->sd < 0 || !c->subscribed)
+			continue;
+
+		if (!match(c->type, ev->type) || !match(c->glob, ev->device) || !match(c->status, ev->status))
+			continue;
+
+		if (!len)
+			len = snprintf(frame, sizeof(frame), "%s\t%s\t%s\t%s\t%s\t%d", ev->type, ev->device,
+				       ev->status, ev->name ? ev->name : "", xd->name, ev->screen);
+		client_send(c, frame);
+	}
+}
+
+/*
+ * Check if any subscriber names event @type, see conf_wants()
+ */
+int sock_wants(const char *type)
+{
+	for (int i = 0; i < SOCK_MAX_CLIENTS; i++) {
+		struct client *c = &clients[i];
+
+		if (c->sd >= 0 && c->subscribed && strcmp(c->type, "*") && !fnmatch(c->type, type, 0))
+			return 1;
+	}
+
+	return 0;
+}
+
+int sock_init(void)
+{
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	const char *dir;
+	int i;
+
+	for (i = 0; i < SOCK_MAX_CLIENTS; i++)
+		clients[i].sd = -1;
+
+	dir = getenv("XDG_RUNTIME_DIR");
+	if (!dir) {
+		syslog(LOG_NOTICE, "XDG_RUNTIME_DIR not set, no control socket");
+		return -1;
+	}
+
+	snprintf(sockpath, sizeof(sockpath), "%s/%s", dir, SOCK_FILE);
+	snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", sockpath);
+
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock == -1)
+		goto fail;
+
+	unlink(sockpath);
+	if (bind(sock, (struct sockaddr *)&sa, sizeof(sa)) || listen(sock, 8)) {
+		close(sock);
+		sock = -1;
+		goto fail;
+	}
+	chmod(sockpath, 0600);
+
+	return loop_add(sock, sock_accept, NULL);
+fail:
+	syslog(LOG_ERR, "Failed creating control socket %s: %s", sockpath, strerror(errno));
+	return -1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
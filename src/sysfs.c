@@ -0,0 +1,210 @@
+/* Kernel DRM connector EDID and status from sysfs
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include "xplugd.h"
+#include "edid.h"
+
+/*
+ * The kernel names connectors after their DRM type and a 1-based index,
+ * e.g. card0-HDMI-A-1, while X drivers use their own scheme: HDMI-1 for
+ * modesetting, HDMI1 for intel.  Reduce both to lower case alphanumerics
+ * with a few well-known aliases, so they compare equal.  A match is only
+ * a candidate: drivers that number from zero, like amdgpu, name another
+ * connector the same, its DisplayPort-1 reduces to dp1 like card0-DP-1,
+ * which is the first DP port, not the second.  See connector().
+ */
+static void normalize(const char *name, char *buf, size_t len)
+{
+	static const struct {
+		const char *alias;
+		const char *name;
+	} aliases[] = {
+		{ "hdmia",       "hdmi" },
+		{ "displayport", "dp"   },
+		{ NULL, NULL }
+	};
+	size_t i = 0;
+
+	while (*name && i + 1 < len) {
+		if (isalnum((unsigned char)*name))
+			buf[i++] = tolower((unsigned char)*name);
+		name++;
+	}
+	buf[i] = 0;
+
+	for (i = 0; aliases[i].alias; i++) {
+		size_t n = strlen(aliases[i].alias);
+
+		if (!strncmp(buf, aliases[i].alias, n) && isdigit((unsigned char)buf[n])) {
+			memmove(&buf[strlen(aliases[i].name)], &buf[n], strlen(&buf[n]) + 1);
+			memcpy(buf, aliases[i].name, strlen(aliases[i].name));
+			break;
+		}
+	}
+}
+
+static ssize_t readfile(const char *dir, const char *file, void *buf, size_t len)
+{
+	char path[300];
+	ssize_t num = 0;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	while ((size_t)num < len) {
+		ssize_t n;
+
+		n = read(fd, (char *)buf + num, len - num);
+		if (n <= 0) {
+			if (n == -1 && errno == EINTR)
+				continue;
+			break;
+		}
+		num += n;
+	}
+	close(fd);
+
+	return num;
+}
+
+/*
+ * Find the sysfs directory of the DRM connector for RandR @output,
+ * e.g. /sys/class/drm/card0-HDMI-A-1 for HDMI-1.  Names alone are not
+ * reliable, see normalize(), so @id, the DRM connector id from the
+ * RandR CONNECTOR_ID property, must equal the connector_id of the
+ * candidate.  Without an id on either side, or if more than one card
+ * has the same name and id, nothing is used and the caller falls back
+ * to RandR.
+ */
+static int connector(const char *root, const char *output, unsigned int id, char *path, size_t len)
+{
+	char want[32], name[32];
+	struct dirent *d;
+	char dir[256];
+	int found = 0;
+	DIR *dp;
+
+	if (!id)
+		return -1;
+
+	snprintf(dir, sizeof(dir), "%s/class/drm", root);
+	dp = opendir(dir);
+	if (!dp)
+		return -1;
+
+	normalize(output, want, sizeof(want));
+	while ((d = readdir(dp))) {
+		char file[300], buf[16] = { 0 };
+		char *conn;
+
+		if (strncmp(d->d_name, "card", 4))
+			continue;
+
+		conn = strchr(d->d_name, '-');
+		if (!conn)
+			continue;
+
+		normalize(conn + 1, name, sizeof(name));
+		if (strcmp(name, want))
+			continue;
+
+		if (snprintf(file, sizeof(file), "%s/%s", dir, d->d_name) >= (int)sizeof(file))
+			continue;
+		if (readfile(file, "connector_id", buf, sizeof(buf) - 1) <= 0 ||
+		    strtoul(buf, NULL, 10) != id)
+			continue;
+
+		if (found++)
+			break;
+		if (snprintf(path, len, "%s", file) >= (int)len) {
+			found = 0;
+			break;
+		}
+	}
+	closedir(dp);
+
+	if (found > 1)
+		syslog(LOG_DEBUG, "Output %s matches more than one DRM connector", output);
+
+	return found == 1 ? 0 : -1;
+}
+
+/*
+ * Connection status of @output according to the kernel, one of
+ * RR_Connected, RR_Disconnected, or RR_UnknownConnection.  Returns
+ * -1 if there is no matching DRM connector under @root.
+ */
+int sysfs_status(const char *root, const char *output, unsigned int id)
+{
+	char path[256], buf[16] = { 0 };
+
+	if (connector(root, output, id, path, sizeof(path)))
+		return -1;
+
+	if (readfile(path, "status", buf, sizeof(buf) - 1) <= 0)
+		return -1;
+
+	if (!strncmp(buf, "connected", 9))
+		return RR_Connected;
+	if (!strncmp(buf, "disconnected", 12))
+		return RR_Disconnected;
+
+	return RR_UnknownConnection;
+}
+
+/*
+ * Read the EDID of a connected @output directly from the kernel, the
+ * @root argument is usually "/sys", @id as for connector().  Returns
+ * the length of the EDID, or 0 if the connector is not found, is not
+ * unique, not connected, or the EDID is missing or invalid, in which
+ * case the caller should fall back to the RandR output property.
+ */
+size_t sysfs_edid(const char *root, const char *output, unsigned int id, unsigned char *buf, size_t len)
+{
+	char path[256], status[16] = { 0 };
+	ssize_t num;
+
+	if (connector(root, output, id, path, sizeof(path)))
+		return 0;
+
+	if (readfile(path, "status", status, sizeof(status) - 1) <= 0 || strncmp(status, "connected", 9))
+		return 0;
+
+	num = readfile(path, "edid", buf, len);
+	if (num <= 0 || !edid_valid(buf, num))
+		return 0;
+
+	return edid_length(buf, num);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
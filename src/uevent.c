@@ -0,0 +1,148 @@
+/* Kernel uevent listener, pre-warms EDID and topology on DRM hotplug
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include "xplugd.h"
+
+#define UEVENT_BUFSZ 8192
+
+static int match(const char *var, size_t len, const char *str)
+{
+	return len == strlen(str) && !memcmp(var, str, len);
+}
+
+/*
+ * A uevent is a header, "ACTION@DEVPATH", followed by NUL separated
+ * KEY=VALUE pairs.  We are only interested in DRM hotplug events.
+ */
+int uevent_is_hotplug(const char *buf, size_t len)
+{
+	int drm = 0, hotplug = 0;
+	size_t pos = 0;
+
+	while (pos < len) {
+		const char *var = &buf[pos];
+		size_t n = strnlen(var, len - pos);
+
+		if (match(var, n, "SUBSYSTEM=drm"))
+			drm = 1;
+		else if (match(var, n, "HOTPLUG=1"))
+			hotplug = 1;
+
+		pos += n + 1;
+	}
+
+	return drm && hotplug;
+}
+
+static void uevent_read(int sd, void *arg)
+{
+	struct xdisplay *d;
+	char buf[UEVENT_BUFSZ];
+	struct sockaddr_nl sa;
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len  = sizeof(buf) - 1,
+	};
+	struct msghdr msg = {
+		.msg_name    = &sa,
+		.msg_namelen = sizeof(sa),
+		.msg_iov     = &iov,
+		.msg_iovlen  = 1,
+	};
+	ssize_t len;
+
+	len = recvmsg(sd, &msg, MSG_DONTWAIT);
+	if (len <= 0) {
+		if (len == 0 || (errno != EAGAIN && errno != EINTR)) {
+			syslog(LOG_WARNING, "Kernel uevent listener failed, disabling: %s",
+			       len ? strerror(errno) : "socket closed");
+			loop_del(sd);
+			close(sd);
+		}
+		return;
+	}
+	buf[len] = 0;
+
+	/* Only trust the kernel, a socketpair has no sender address */
+	if (msg.msg_namelen == sizeof(sa) && sa.nl_pid != 0)
+		return;
+
+	if (!uevent_is_hotplug(buf, len))
+		return;
+
+	/*
+	 * Do not know which server drives the connector, ask all local
+	 * ones.  Remote servers, e.g. Xvnc, never see our connectors, and
+	 * a full re-probe of each is not cheap.
+	 */
+	syslog(LOG_DEBUG, "Kernel DRM hotplug event, pre-warming EDID and topology");
+	for (d = display_list(); d; d = d->next) {
+		if (!d->local)
+			continue;
+
+		xd = d;
+		randr_prewarm(d->dpy);
+		snapshot_update();
+	}
+}
+
+/*
+ * Listen to kernel uevents on @sd, or on a new netlink socket if @sd
+ * is -1.  The former allows a socketpair() to feed fake uevents.
+ */
+int uevent_init(int sd)
+{
+	struct sockaddr_nl sa = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,		/* Kernel uevents, not udev */
+	};
+
+	if (sd < 0) {
+		sd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+		if (sd == -1) {
+			syslog(LOG_ERR, "Failed opening kernel uevent socket: %s", strerror(errno));
+			return -1;
+		}
+
+		if (bind(sd, (struct sockaddr *)&sa, sizeof(sa))) {
+			syslog(LOG_ERR, "Failed binding kernel uevent socket: %s", strerror(errno));
+			close(sd);
+			return -1;
+		}
+	}
+
+	if (loop_add(sd, uevent_read, NULL)) {
+		close(sd);
+		return -1;
+	}
+
+	return sd;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
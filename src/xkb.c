@@ -0,0 +1,226 @@
+/* Built-in XKB keymap action, replaces forking setxkbmap
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The xkb action takes setxkbmap style settings as KEY=VALUE:
+ *
+ *    keyboard connected * xkb layout=us,se options=ctrl:nocaps,grp:alt_shift_toggle
+ *
+ * Valid keys are rules, model, layout, variant, and options.  Settings
+ * not given are taken from the server's current _XKB_RULES_NAMES, like
+ * setxkbmap does.  The keymap is compiled once per display, when the
+ * rule is read, and shared by all rules with the same settings.  On a match it is
+ * uploaded only to the keyboard that was connected.
+ */
+
+#include <X11/XKBlib.h>
+#include <X11/extensions/XKBrules.h>
+#include "xplugd.h"
+
+struct keymap {
+	Display       *dpy;		/* Keymaps hold atoms of the server */
+	char          *key;
+	XkbDescPtr     xkb;
+	struct keymap *next;
+};
+
+static struct keymap *keymaps;
+
+static int setting(XkbRF_VarDefsRec *vd, char **rules, char *arg)
+{
+	char *val;
+
+	val = strchr(arg, '=');
+	if (!val)
+		return -1;
+	*val++ = 0;
+
+	if (!strcmp(arg, "rules"))
+		*rules = val;
+	else if (!strcmp(arg, "model"))
+		vd->model = val;
+	else if (!strcmp(arg, "layout"))
+		vd->layout = val;
+	else if (!strcmp(arg, "variant"))
+		vd->variant = val;
+	else if (!strcmp(arg, "options"))
+		vd->options = val;
+	else
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Resolve rules to components and let the server compile the keymap,
+ * without loading it, like setxkbmap but only once.
+ */
+static XkbDescPtr compile(Display *dpy, const char *rules, XkbRF_VarDefsRec *vd)
+{
+	XkbComponentNamesRec names;
+	XkbRF_RulesPtr xr;
+	XkbDescPtr xkb;
+	char path[256];
+
+	if (rules[0] == '/')
+		snprintf(path, sizeof(path), "%s", rules);
+	else
+		snprintf(path, sizeof(path), "%s/%s", XKB_RULES_DIR, rules);
+
+	xr = XkbRF_Load(path, "C", True, True);
+	if (!xr) {
+		syslog(LOG_WARNING, "Failed loading XKB rules %s", path);
+		return NULL;
+	}
+
+	memset(&names, 0, sizeof(names));
+	if (!XkbRF_GetComponents(xr, vd, &names)) {
+		XkbRF_Free(xr, True);
+		return NULL;
+	}
+	XkbRF_Free(xr, True);
+
+	syslog(LOG_DEBUG, "XKB keycodes %s, types %s, compat %s, symbols %s", names.keycodes,
+	       names.types, names.compat, names.symbols);
+	xkb = XkbGetKeyboardByName(dpy, XkbUseCoreKbd, &names, XkbGBN_AllComponentsMask,
+				   XkbGBN_AllComponentsMask & ~XkbGBN_GeometryMask, False);
+
+	free(names.keycodes);
+	free(names.types);
+	free(names.compat);
+	free(names.symbols);
+	free(names.geometry);
+
+	return xkb;
+}
+
+int xkb_init(Display *dpy, struct rule *r)
+{
+	int major = XkbMajorVersion, minor = XkbMinorVersion;
+	char *rules = NULL, *server_rules = NULL;
+	XkbRF_VarDefsRec vd, server;
+	struct keymap *km;
+	char key[512];
+	int i, rc = -1;
+
+	if (!XkbQueryExtension(dpy, NULL, NULL, NULL, &major, &minor)) {
+		syslog(LOG_WARNING, "XKB extension not available");
+		return -1;
+	}
+
+	memset(&server, 0, sizeof(server));
+	XkbRF_GetNamesProp(dpy, &server_rules, &server);
+	vd = server;
+
+	for (i = 0; i < r->argc; i++) {
+		if (setting(&vd, &rules, r->argv[i]))
+			goto done;
+	}
+	if (!rules)
+		rules = server_rules ? server_rules : XKB_RULES_DEFAULT;
+
+	snprintf(key, sizeof(key), "%s:%s:%s:%s:%s", rules, vd.model ? vd.model : "",
+		 vd.layout ? vd.layout : "", vd.variant ? vd.variant : "", vd.options ? vd.options : "");
+	for (km = keymaps; km; km = km->next) {
+		if (km->dpy == dpy && !strcmp(km->key, key))
+			break;
+	}
+
+	if (!km) {
+		km = calloc(1, sizeof(*km));
+		if (!km)
+			goto done;
+
+		km->dpy = dpy;
+		km->xkb = compile(dpy, rules, &vd);
+		km->key = strdup(key);
+		if (!km->xkb || !km->key) {
+			syslog(LOG_WARNING, "Failed compiling XKB keymap %s", key);
+			if (km->xkb)
+				XkbFreeKeyboard(km->xkb, XkbAllComponentsMask, True);
+			free(km->key);
+			free(km);
+			goto done;
+		}
+
+		km->next = keymaps;
+		keymaps = km;
+		syslog(LOG_DEBUG, "Compiled XKB keymap %s", key);
+	}
+
+	r->priv = km;
+	rc = 0;
+done:
+	free(server_rules);
+	free(server.model);
+	free(server.layout);
+	free(server.variant);
+	free(server.options);
+
+	return rc;
+}
+
+int xkb_run(Display *dpy, struct rule *r, struct event *ev)
+{
+	struct keymap *km = r->priv;
+
+	if (strcmp(ev->type, "keyboard")) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	km->xkb->device_spec = atoi(ev->device);
+	if (!XkbSetMap(dpy, XkbAllMapComponentsMask, km->xkb) ||
+	    !XkbSetCompatMap(dpy, XkbAllCompatMask, km->xkb, True)) {
+		errno = EIO;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Free all keymaps compiled for @dpy, when the display is closed
+ */
+void xkb_exit(Display *dpy)
+{
+	struct keymap **prev = &keymaps, *km;
+
+	while ((km = *prev)) {
+		if (km->dpy != dpy) {
+			prev = &km->next;
+			continue;
+		}
+
+		*prev = km->next;
+		XkbFreeKeyboard(km->xkb, XkbAllComponentsMask, True);
+		free(km->key);
+		free(km);
+	}
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
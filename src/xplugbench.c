@@ -0,0 +1,214 @@
+/* xplugbench - measure plugin dispatch cost against forking a hook
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Loads a plugin, without any X connection, and calls it with made up
+ * display and input events.  For comparison the same number of events,
+ * capped, is sent to a hook the way xplugd calls its script: fork and
+ * exec, here with /bin/true as the cheapest possible script.
+ */
+
+#include "config.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "plugin.h"
+
+#define HOOK     "/bin/true"
+#define MAX_FORK 1000
+
+static struct xplugd_output outputs[2] = {
+	{ .id = 1, .name = "eDP-1",  .connection = RR_Connected, .crtc = 1, .width = 1920, .height = 1200,
+	  .vendor = "LEN", .model = "Internal" },
+	{ .id = 2, .name = "HDMI-1", .connection = RR_Connected, .crtc = 2, .x = 1920, .width = 2560,
+	  .height = 1440, .vendor = "DEL", .model = "DELL U2720Q" },
+};
+
+static struct xplugd_device devices[1] = {
+	{ .id = 12, .use = 3, .enabled = 1, .name = "SynPS/2 Synaptics TouchPad" },
+};
+
+static const struct xplugd_output *bench_outputs(int *num)
+{
+	*num = sizeof(outputs) / sizeof(outputs[0]);
+	return outputs;
+}
+
+static const struct xplugd_device *bench_devices(int *num)
+{
+	*num = sizeof(devices) / sizeof(devices[0]);
+	return devices;
+}
+
+static int bench_layout(const char *spec)
+{
+	return 0;
+}
+
+static const struct xplugd_api api = {
+	.abi     = XPLUGD_PLUGIN_ABI,
+	.outputs = bench_outputs,
+	.devices = bench_devices,
+	.layout  = bench_layout,
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_plugin(const struct xplugd_plugin *p, long num)
+{
+	struct xplugd_event display = { "display", "HDMI-1", "connected", "DELL U2720Q", ":0", 0 };
+	struct xplugd_event input = { "pointer", "12", "connected", devices[0].name, ":0", 0 };
+	struct monitor_info edid;
+	double start;
+	long i;
+
+	memset(&edid, 0, sizeof(edid));
+	strcpy(edid.manufacturer_code, "DEL");
+	strcpy(edid.dsc_product_name, "DELL U2720Q");
+	edid.width_mm  = 597;
+	edid.height_mm = 336;
+
+	start = now();
+	for (i = 0; i < num; i++) {
+		if (i & 1) {
+			if (p->on_input)
+				p->on_input(&input, &devices[0]);
+		} else {
+			if (p->on_display)
+				p->on_display(&display, &outputs[1], &edid);
+		}
+	}
+
+	return now() - start;
+}
+
+static double bench_fork(long num)
+{
+	double start;
+	long i;
+
+	start = now();
+	for (i = 0; i < num; i++) {
+		char *args[] = { HOOK, "display", "HDMI-1", "connected", "DELL U2720Q", NULL };
+		pid_t pid;
+
+		pid = fork();
+		if (!pid) {
+			execv(args[0], args);
+			_exit(1);
+		}
+		if (pid > 0)
+			waitpid(pid, NULL, 0);
+	}
+
+	return now() - start;
+}
+
+static int usage(int status)
+{
+	printf("Usage: xplugbench [-h] [-n NUM] PLUGIN [ARG ...]\n\n"
+	       "Options:\n"
+	       "  -h        Print this help text and exit\n"
+	       "  -n NUM    Number of events, default 1000000\n"
+	       "\n"
+	       "Calls PLUGIN, e.g. ./example.so quiet, NUM times and then forks %s,\n"
+	       "at most %d times, to compare the cost per event.\n"
+	       "\n"
+	       "Bug report address: %s\n", HOOK, MAX_FORK, PACKAGE_BUGREPORT);
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct xplugd_plugin *p;
+	double plugin, hook;
+	long num = 1000000, forks;
+	void *handle;
+	int c;
+
+	while ((c = getopt(argc, argv, "hn:")) != EOF) {
+		switch (c) {
+		case 'h':
+			return usage(0);
+
+		case 'n':
+			num = atol(optarg);
+			break;
+
+		default:
+			return usage(1);
+		}
+	}
+
+	if (optind >= argc || num < 1)
+		return usage(1);
+
+	handle = dlopen(argv[optind], RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+		fprintf(stderr, "xplugbench: %s\n", dlerror());
+		return 1;
+	}
+
+	p = dlsym(handle, "xplugd_plugin");
+	if (!p || p->abi > XPLUGD_PLUGIN_ABI) {
+		fprintf(stderr, "xplugbench: %s is not a compatible xplugd plugin\n", argv[optind]);
+		return 1;
+	}
+
+	if (p->init && p->init(&api, argc - optind, &argv[optind])) {
+		fprintf(stderr, "xplugbench: %s failed to initialize\n", argv[optind]);
+		return 1;
+	}
+
+	plugin = bench_plugin(p, num);
+	forks  = num < MAX_FORK ? num : MAX_FORK;
+	hook   = bench_fork(forks);
+
+	if (p->exit)
+		p->exit();
+
+	printf("%-8s %10ld events %10.3f s %12.1f ns/event\n", "plugin", num, plugin, plugin * 1e9 / num);
+	printf("%-8s %10ld events %10.3f s %12.1f ns/event\n", "fork", forks, hook, hook * 1e9 / forks);
+	printf("Plugin dispatch is %.0fx faster than forking %s\n",
+	       (hook / forks) / (plugin / num), HOOK);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
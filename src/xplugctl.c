@@ -0,0 +1,312 @@
+/* xplugctl - query and control a running xplugd
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+#include <getopt.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "snapshot.h"
+
+#define SOCK_FILE      "xplugd.sock"
+#define SOCK_FRAME_LEN 512
+
+static char *prognm;
+static char *display;
+static char *snapshot_file;
+static char *sock_file;
+
+static int ctl_connect(void)
+{
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	const char *dir;
+	int sd;
+
+	if (sock_file) {
+		snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", sock_file);
+	} else {
+		dir = getenv("XDG_RUNTIME_DIR");
+		if (!dir) {
+			fprintf(stderr, "%s: XDG_RUNTIME_DIR not set\n", prognm);
+			return -1;
+		}
+		snprintf(sa.sun_path, sizeof(sa.sun_path), "%s/%s", dir, SOCK_FILE);
+	}
+
+	sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sd == -1)
+		goto fail;
+
+	if (connect(sd, (struct sockaddr *)&sa, sizeof(sa))) {
+		close(sd);
+		goto fail;
+	}
+
+	return sd;
+fail:
+	fprintf(stderr, "%s: cannot connect to %s, is xplugd running? %s\n", prognm, sa.sun_path, strerror(errno));
+	return -1;
+}
+
+/*
+ * Send command and wait for its reply, "ok" or "error<TAB>reason"
+ */
+static int ctl_command(int sd, const char *cmd)
+{
+	char buf[SOCK_FRAME_LEN];
+	ssize_t len = -1;
+
+	if (send(sd, cmd, strlen(cmd), MSG_NOSIGNAL) == -1)
+		goto fail;
+
+	len = recv(sd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		goto fail;
+	buf[len] = 0;
+
+	if (!strcmp(buf, "ok"))
+		return 0;
+
+	fprintf(stderr, "%s: %s\n", prognm, strncmp(buf, "error\t", 6) ? buf : &buf[6]);
+	return 1;
+fail:
+	fprintf(stderr, "%s: lost connection to xplugd: %s\n", prognm, len ? strerror(errno) : "closed");
+	return 1;
+}
+
+/*
+ * With many displays, commands act on the one given with -d, or the
+ * first one watched by xplugd
+ */
+static int select_display(int sd)
+{
+	char buf[SOCK_FRAME_LEN];
+
+	if (!display)
+		return 0;
+
+	snprintf(buf, sizeof(buf), "display %s", display);
+
+	return ctl_command(sd, buf);
+}
+
+/*
+ * Send one command with its arguments and wait for the reply
+ */
+static int request(const char *cmd, int argc, char *argv[])
+{
+	char buf[SOCK_FRAME_LEN];
+	int sd, rc, i;
+
+	snprintf(buf, sizeof(buf), "%s", cmd);
+	for (i = 0; i < argc; i++) {
+		size_t n = strlen(buf);
+
+		snprintf(&buf[n], sizeof(buf) - n, " %s", argv[i]);
+	}
+
+	sd = ctl_connect();
+	if (sd == -1)
+		return 1;
+
+	rc = select_display(sd);
+	if (!rc)
+		rc = ctl_command(sd, buf);
+	close(sd);
+
+	return rc;
+}
+
+static int monitor(int argc, char *argv[])
+{
+	char buf[SOCK_FRAME_LEN];
+	ssize_t len;
+	int sd, i;
+
+	sd = ctl_connect();
+	if (sd == -1)
+		return 1;
+
+	snprintf(buf, sizeof(buf), "subscribe");
+	for (i = 0; i < argc && i < 3; i++) {
+		size_t n = strlen(buf);
+
+		snprintf(&buf[n], sizeof(buf) - n, " %s", argv[i]);
+	}
+
+	if (ctl_command(sd, buf)) {
+		close(sd);
+		return 1;
+	}
+
+	while ((len = recv(sd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[len] = 0;
+		puts(buf);
+		fflush(stdout);
+	}
+	close(sd);
+
+	return 0;
+}
+
+static const char *status(uint32_t connection)
+{
+	switch (connection) {
+	case SNAPSHOT_CONNECTED:
+		return "connected";
+	case SNAPSHOT_DISCONNECTED:
+		return "disconnected";
+	}
+
+	return "unknown";
+}
+
+static const char *use(uint32_t use)
+{
+	/* XI2 device use, from XI2.h */
+	static const char *uses[] = {
+		"", "master-pointer", "master-keyboard", "pointer", "keyboard", "floating"
+	};
+
+	if (use < sizeof(uses) / sizeof(uses[0]))
+		return uses[use];
+
+	return "unknown";
+}
+
+static int show_status(void)
+{
+	const struct snapshot *shm;
+	struct snapshot snap;
+	uint32_t i;
+
+	shm = snapshot_open(snapshot_file);
+	if (!shm) {
+		fprintf(stderr, "%s: cannot open snapshot, is xplugd running? %s\n", prognm, strerror(errno));
+		return 1;
+	}
+
+	if (snapshot_read(shm, &snap)) {
+		fprintf(stderr, "%s: failed reading snapshot: %s\n", prognm, strerror(errno));
+		snapshot_close(shm);
+		return 1;
+	}
+	snapshot_close(shm);
+
+	printf("%-12s %-3s %-12s %-20s %-10s %-16s %-3s %s\n", "OUTPUT", "SCR", "STATUS", "GEOMETRY",
+	       "SIZE", "EDID HASH", "VID", "MODEL");
+	for (i = 0; i < snap.num_outputs && i < SNAPSHOT_MAX_OUTPUTS; i++) {
+		struct snapshot_output *o = &snap.outputs[i];
+		char geo[32] = "-", size[24] = "-", hash[20] = "-";
+
+		if (o->width)
+			snprintf(geo, sizeof(geo), "%ux%u+%d+%d", o->width, o->height, o->x, o->y);
+		if (o->mm_width)
+			snprintf(size, sizeof(size), "%ux%u", o->mm_width, o->mm_height);
+		if (o->edid_hash)
+			snprintf(hash, sizeof(hash), "%016" PRIx64, o->edid_hash);
+
+		printf("%-12.32s %-3u %-12s %-20s %-10s %-16s %-3.3s %.14s\n", o->name, o->screen,
+		       status(o->connection), geo, size, hash, o->vendor[0] ? o->vendor : "-", o->model);
+	}
+
+	printf("\n%-4s %-16s %-8s %s\n", "ID", "TYPE", "ENABLED", "NAME");
+	for (i = 0; i < snap.num_devices && i < SNAPSHOT_MAX_DEVICES; i++) {
+		struct snapshot_device *d = &snap.devices[i];
+
+		printf("%-4d %-16s %-8s %.64s\n", d->id, use(d->use), d->enabled ? "yes" : "no", d->name);
+	}
+
+	return 0;
+}
+
+static int usage(int status)
+{
+	printf("Usage: %s [-h] [-d DISP] [-f FILE] [-s SOCK] [COMMAND]\n\n"
+	       "Options:\n"
+	       "  -d DISP   X display, when xplugd watches many, or screen, e.g. :1 or :0.1\n"
+	       "  -f FILE   Topology snapshot, default $XDG_RUNTIME_DIR/%s\n"
+	       "  -h        Print this help text and exit\n"
+	       "  -s SOCK   Control socket, default $XDG_RUNTIME_DIR/%s\n"
+	       "\n"
+	       "Commands:\n"
+	       "  status                         Show current outputs and input devices, default\n"
+	       "  monitor [TYPE [GLOB [STATUS]]] Show events as they happen, optionally filtered\n"
+	       "  layout SPEC                    Apply output layout, e.g. 'eDP-1 auto; HDMI-1 auto right-of eDP-1'\n"
+	       "  save                           Save current layout as profile for the connected displays\n"
+	       "\n"
+	       "Bug report address: %s\n", prognm, SNAPSHOT_FILE, SOCK_FILE, PACKAGE_BUGREPORT);
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	char *command = "status";
+	int c;
+
+	prognm = strrchr(argv[0], '/');
+	prognm = prognm ? prognm + 1 : argv[0];
+
+	while ((c = getopt(argc, argv, "d:f:hs:")) != EOF) {
+		switch (c) {
+		case 'd':
+			display = optarg;
+			setenv("DISPLAY", display, 1); /* For snapshot_open() */
+			break;
+
+		case 'f':
+			snapshot_file = optarg;
+			break;
+
+		case 'h':
+			return usage(0);
+
+		case 's':
+			sock_file = optarg;
+			break;
+
+		default:
+			return usage(1);
+		}
+	}
+
+	if (optind < argc)
+		command = argv[optind++];
+
+	if (!strcmp(command, "status"))
+		return show_status();
+	if (!strcmp(command, "monitor"))
+		return monitor(argc - optind, &argv[optind]);
+	if (!strcmp(command, "layout") && optind < argc)
+		return request(command, argc - optind, &argv[optind]);
+	if (!strcmp(command, "save"))
+		return request(command, 0, NULL);
+
+	return usage(1);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -24,15 +24,24 @@
 
 #define SYSLOG_NAMES
 #include <glob.h>
+#include <setjmp.h>
 #ifndef GLOB_TILDE
 # include <alloca.h>
 #endif
 #include "xplugd.h"
 
 int loglevel = LOG_NOTICE;
+int multi;
 char *cmd;
+char *conffile;
 char *prognm;
 
+#ifndef HAVE_XSETIOERROREXITHANDLER
+static jmp_buf lost;
+#endif
+static int reconnect;
+static int running;
+
 static char *tilde_expand(char *path)
 {
 	glob_t gl;
@@ -108,6 +117,33 @@ static char *rcfile(char *arg)
 	return arg;
 }
 
+/*
+ * Returns path to @name in $XDG_CONFIG_HOME, or ~/.config, the file
+ * does not need to exist.  Caller must free the returned string.
+ */
+char *config_file(const char *name)
+{
+	const char *dir, *sub = "";
+	char *path;
+	size_t len;
+
+	dir = getenv("XDG_CONFIG_HOME");
+	if (!dir) {
+		dir = getenv("HOME");
+		if (!dir)
+			return NULL;
+		sub = "/.config";
+	}
+
+	len = strlen(dir) + strlen(sub) + strlen(name) + 2;
+	path = malloc(len);
+	if (!path)
+		return NULL;
+	snprintf(path, len, "%s%s/%s", dir, sub, name);
+
+	return path;
+}
+
 static int loglvl(char *level)
 {
 	for (int i = 0; prioritynames[i].c_name; i++) {
@@ -118,28 +154,99 @@ static int loglvl(char *level)
 	return atoi(level);
 }
 
+/*
+ * Dispatch an event to all consumers: subscribers, rules, plugins, and
+ * the script, unless the rules say it is not interested or a plugin
+ * has handled the event.  What they build for the event is taken from
+ * the arena, dropped when the outermost event is done.
+ */
+void notify(struct event *ev)
+{
+	static int depth;
+	int applied, run;
+
+	depth++;
+	sock_notify(ev);
+
+	/*
+	 * Known display combination, apply the stored layout first, so
+	 * rules and plugins, e.g. dpi, see the new geometry
+	 */
+	applied = !strcmp(ev->type, "display") && profile_apply();
+
+	run = conf_run(ev);
+	if (plugin_run(ev) || applied)
+		run = 0;
+
+	if (run)
+		exec(ev);
+	if (--depth == 0)
+		arena_reset();
+}
+
+/*
+ * Lost connection to an X server.  With one display we exit, like
+ * before, unless asked to reconnect.  Otherwise the display is dropped
+ * by display_dispatch(), and reopened when the server is back.  Xlib
+ * exits when this handler returns, unless it has an exit handler, see
+ * display_add().  Older Xlib has none, so jump back to the main loop.
+ */
 static int error_handler(Display *display)
 {
-	exit(1);
+	struct xdisplay *d;
+
+	if ((!multi && !reconnect) || !running)
+		exit(1);
+
+	d = display_find(display);
+	if (!d)
+		exit(1);
+
+	d->lost = 1;
+#ifdef HAVE_XSETIOERROREXITHANDLER
+	return 0;
+#else
+	longjmp(lost, 1);
+#endif
+}
+
+/*
+ * Protocol errors, e.g. BadMatch from a layout the server cannot do,
+ * must not take down the daemon like the default handler does.
+ */
+static int x_error_handler(Display *display, XErrorEvent *err)
+{
+	char msg[80];
+
+	XGetErrorText(display, err->error_code, msg, sizeof(msg));
+	syslog(LOG_WARNING, "X error: %s, request %d.%d", msg, err->request_code, err->minor_code);
+
+	return 0;
 }
 
 static int usage(int status)
 {
-	printf("Usage: %s [-hnpsv] [-l LEVEL] [FILE]\n\n"
+	printf("Usage: %s [-hnprsuv] [-c CONF] [-d DISPLAY] [-l LEVEL] [-w DIR] [FILE]\n\n"
 	       "Options:\n"
+	       "  -c CONF   Rules with built-in actions, default $XDG_CONFIG_HOME/%s\n"
+	       "  -d DISP   X display to watch, may be given many times, default $DISPLAY\n"
 	       "  -h        Print this help text and exit\n"
 	       "  -l LEVEL  Set log level: none, err, info, notice*, debug\n"
 	       "  -n        Run in foreground, do not fork to background\n"
 	       "  -p        Probe currently connected outputs and output EDID info\n"
+	       "  -r        Reconnect, wait for local displays to start, or restart\n"
 	       "  -s        Use syslog, even if running in foreground, default w/o -n\n"
+	       "  -u        Listen for kernel DRM hotplug uevents, pre-warms EDID and topology\n"
 	       "  -v        Show program version\n"
+	       "  -w DIR    Watch DIR for new local X servers, e.g. /tmp/.X11-unix\n"
 	       "\n"
 	       " FILE       Optional script argument, default $XDG_CONFIG_HOME/xplugrc\n"
 	       "            Fallback also checks for ~/.config/xplugrc and ~/.xplugrc\n"
+	       "            Hooks in $XDG_CONFIG_HOME/xplugrc.d/ are also called\n"
 	       "\n"
 	       "Copyright (C) 2012-2015  Stefan Bolte\n"
 	       "Copyright (C) 2016-2023  Joachim Wiberg\n\n"
-	       "Bug report address: %s\n", prognm, PACKAGE_BUGREPORT);
+	       "Bug report address: %s\n", prognm, CONF_FILE, PACKAGE_BUGREPORT);
 	return status;
 }
 
@@ -164,18 +271,33 @@ static char *progname(char *arg0)
 
 int main(int argc, char *argv[])
 {
-	Display *dpy;
-	XEvent ev;
+	Display *dpy[DISPLAY_MAX_ARGS];
+	char *name[DISPLAY_MAX_ARGS];
 	char *arg = NULL;
+	char *watch = NULL;
 	int background = 1;
 	int log_opts = LOG_CONS | LOG_PID;
 	int logcons = 0;
+	int uevent = 0;
 	int mode = 0;
-	int c;
+	int num = 0;
+	int c, i;
 
 	prognm = progname(argv[0]);
-	while ((c = getopt(argc, argv, "hl:npsv")) != EOF) {
+	while ((c = getopt(argc, argv, "c:d:hl:nprsuvw:")) != EOF) {
 		switch (c) {
+		case 'c':
+			conffile = optarg;
+			break;
+
+		case 'd':
+			if (num >= DISPLAY_MAX_ARGS) {
+				fprintf(stderr, "Too many displays, max %d\n", DISPLAY_MAX_ARGS);
+				return 1;
+			}
+			name[num++] = optarg;
+			break;
+
 		case 'h':
 			return usage(0);
 
@@ -192,32 +314,60 @@ int main(int argc, char *argv[])
 			mode = 1;
 			break;
 
+		case 'r':
+			reconnect = 1;
+			break;
+
 		case 's':
 			logcons--;
 			break;
 
+		case 'u':
+			uevent = 1;
+			break;
+
 		case 'v':
 			return version();
 
+		case 'w':
+			watch = optarg;
+			break;
+
 		default:
 			return usage(1);
 		}
 	}
 
-	dpy = XOpenDisplay(NULL);
-	if (dpy == NULL) {
-		fprintf(stderr, "Cannot open display\n");
-		exit(1);
+	if (!num && !watch)
+		name[num++] = NULL;
+	multi = num > 1 || watch;
+
+	for (i = 0; i < num; i++) {
+		dpy[i] = XOpenDisplay(name[i]);
+		if (dpy[i] == NULL) {
+			if (reconnect && !mode) {
+				fprintf(stderr, "Display %s not available yet, waiting ...\n", XDisplayName(name[i]));
+				continue;
+			}
+			fprintf(stderr, "Cannot open display %s\n", XDisplayName(name[i]));
+			exit(1);
+		}
 	}
 
-	if (mode)
-		return randr_probe(dpy);
+	if (mode) {
+		for (i = 0; i < num; i++) {
+			if (randr_probe(dpy[i]))
+				return 1;
+		}
+		return 0;
+	}
 
 	if (optind < argc)
 		arg = argv[optind];
 
+	/* Script, hook directory, or both */
 	cmd = rcfile(arg);
-	if (!cmd)
+	if (hook_init() && !cmd)
 		return usage(1);
 
 	if (background) {
@@ -232,20 +382,37 @@ int main(int argc, char *argv[])
 	openlog(prognm, log_opts, LOG_USER);
 	setlogmask(LOG_UPTO(loglevel));
 
-	exec_init(dpy);
-	input_init(dpy);
-	randr_init(dpy);
-	XSync(dpy, False);
 	XSetIOErrorHandler((XIOErrorHandler)error_handler);
+	XSetErrorHandler(x_error_handler);
 
-	while (1) {
-		XNextEvent(dpy, &ev);
+	exec_init();
+	profile_init();
+	if (!conffile)
+		conffile = config_file(CONF_FILE);
 
-		if (is_input_event(dpy, &ev))
-			input_event(dpy, &ev);
-		else
-			randr_event(dpy, &ev);
+	for (i = 0; i < num; i++) {
+		if (dpy[i] && !display_add(dpy[i])) {
+			syslog(LOG_ERR, "Cannot use display %s", DisplayString(dpy[i]));
+			exit(1);
+		}
 	}
+	if (watch)
+		display_watch(watch);
+	for (i = 0; reconnect && i < num; i++)
+		display_reconnect(dpy[i] ? DisplayString(dpy[i]) : XDisplayName(name[i]));
+
+	if (uevent)
+		uevent_init(-1);
+	sock_init();
+
+#ifndef HAVE_XSETIOERROREXITHANDLER
+	/* Lost display, display_dispatch() drops it */
+	setjmp(lost);
+#endif
+	running = 1;
+
+	while (1)
+		loop_poll(display_dispatch());
 
 	return 0;
 }
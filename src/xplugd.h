@@ -28,6 +28,7 @@
 #include "config.h"
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
@@ -35,30 +36,332 @@
 #include <signal.h>
 #include <syslog.h>
 #include <unistd.h>
+#include <sys/types.h>
 #include <sys/wait.h>
 #include <X11/Xlib.h>
 #include <X11/extensions/XInput.h>
 #include <X11/extensions/XInput2.h>
 #include <X11/extensions/Xrandr.h>
+#include "plugin.h"
 
 #define MSG_LEN           128
 #define XPLUGRC           "~/.config/xplugrc"
 #define XPLUGRC_FALLBACK  "~/.xplugrc"
+#define HOOK_DIR          "xplugrc.d"
+#define HOOK_MAX          32		/* Hooks in HOOK_DIR, bits of a mask */
+#define HOOK_EVENTS       8		/* Per hook, in xplug-events: */
+#define HOOK_HEADER_LINES 16		/* Lines read for xplug-* comments */
+#define SYSFS_ROOT        "/sys"
+#define EDID_MAX_LEN      1024		/* Base block + 7 extension blocks */
+#define EDID_CACHE_SIZE   16
+#define MAX_OUTPUTS       32
+#define MAX_DEVICES       64
+#define SEAT_NAME_LEN     32		/* Seat, master device name prefix */
+#define MAX_SCREENS       8		/* Per display, Zaphod multi-head */
+#define MAX_PROVIDERS     8		/* GPUs and display adapters per screen */
+#define ENV_MAX           32		/* Variables set per event */
+#define ARENA_SIZE        (64 * 1024)	/* Per event, see arena.c */
+#define LOOP_MAX_FDS      256
+#define LAYOUT_MAX_LEN    2048		/* Layout spec, all clauses */
+#define LOOP_MAX_TIMERS   64
+#define DISPLAY_MAX_ARGS  64		/* -d DISPLAY */
+#define DISPLAY_MAX_PENDING 16
+#define DISPLAY_RETRIES   10
+#define DISPLAY_RETRY_MS  500
+#define X11_UNIX_DIR      "/tmp/.X11-unix"	/* Local server sockets, X<N> */
+#define LINK_RETRIES      5		/* Retrains of a bad DP link */
+#define LINK_RETRY_MS     250		/* First check, doubled per retry */
+#define CONF_FILE         "xplugd.conf"
+#define RULE_MAX_ARGS     16
+#define RULE_BUCKETS      16		/* Power of two */
+#define XKB_RULES_DIR     "/usr/share/X11/xkb/rules"
+#define XKB_RULES_DEFAULT "evdev"
+#define PLUGIN_MAX        16
+#define PRIME_MAX         8		/* Provider pairs in xplugd.conf */
+#ifndef PLUGINDIR
+#define PLUGINDIR         "/usr/local/lib/xplugd"
+#endif
+#define PROFILES          "xplugd.profiles"
+#define GAMMA_DIR         "xplugd.gamma"
+#define PROFILE_MAX       64		/* Power of two */
+#define SOCK_FILE         "xplugd.sock"
+#define SOCK_MAX_CLIENTS  16
+#define SOCK_QLEN         32		/* Max queued frames per client */
+#define SOCK_FRAME_LEN    512
+
+struct conf;
+struct snapshot;
+
+/* Per X screen state, one root window each */
+struct xscreen {
+	Window        root;
+
+	/* profile.c */
+	uint64_t      last_fp;
+	int           last_match;
+};
+
+/*
+ * Per X display state, see display.c.  All modules keep what depends
+ * on the server here, e.g. atoms and cached topology, and use the
+ * display of the event being handled, xd.
+ */
+struct xdisplay {
+	char          name[64];		/* As given to XOpenDisplay() */
+	Display      *dpy;
+	int           lost;		/* Connection lost, Xlib unusable */
+	int           local;		/* Unix socket, server on this host */
+
+	struct xscreen screens[MAX_SCREENS];
+	int           num_screens;
+	int           screen;		/* Screen of the event being handled */
+
+	/* randr.c */
+	int           rr_event_base;
+	int           rr_version;		/* major * 100 + minor */
+	int           rr_mask;		/* Selected RandR events */
+	Atom          edid_atom;
+	Atom          connector_atom;	/* CONNECTOR_ID, None if unsupported */
+	Atom          link_atom, link_bad;	/* None if no such property */
+	struct xplugd_output outputs[MAX_OUTPUTS];
+	int           num_outputs;
+	char          last_msg[MSG_LEN];
+	RROutput      primed[MAX_OUTPUTS];	/* Announced after pairing */
+	int           num_primed;
+
+	/* input.c */
+	int           xi_opcode;
+	Atom          product_atom, node_atom;
+	struct xplugd_device devices[MAX_DEVICES];
+	int           num_devices;
+
+	/* dpi.c */
+	Atom          screen_res;		/* SCREEN_RESOURCES, None until used */
+
+	/* gamma.c */
+	RRCrtc        gamma_crtc[MAX_OUTPUTS];	/* Ramp size per CRTC */
+	int           gamma_size[MAX_OUTPUTS];
+	int           num_gamma;
+
+	/* conf.c */
+	struct conf  *conf;
+
+	/* snapshot.c */
+	struct snapshot *shm;
+
+	struct xdisplay *next;
+};
+
+/* Plug or RandR event, as passed to the script and subscribers */
+struct event {
+	char         *type;		/* display, keyboard, pointer, crtc, ... */
+	char         *device;		/* Output name, or XInput device id */
+	char         *status;		/* connected, disconnected, unknown */
+	char         *name;		/* Optional description, may be NULL */
+	int           screen;		/* X screen, inputs: default screen */
+	int           input;		/* XInput event, device is the id */
+
+	const struct xplugd_output *output;	/* Output of the event, or NULL */
+};
+
+/* Parsed layout, see layout.c, one entry per output */
+struct layout_output {
+	char          name[32];
+	int           off;
+	int           automode;		/* Preferred mode */
+	unsigned int  width, height;	/* Requested mode size, or 0 */
+	double        rate;		/* Requested refresh rate, or 0 */
+	int           pos, x, y;	/* Absolute position, if pos is set */
+	int           rel;		/* Placement relative to output ref */
+	char          ref[32];
+	int           primary;
+	Rotation      rotation;		/* 0: keep current */
+
+	/* Resolved when applied */
+	RROutput      id;
+	RRCrtc        crtc, cur_crtc;
+	RRMode        mode, cur_mode;
+	Rotation      cur_rotation;
+	int           cur_x, cur_y;
+	unsigned int  cur_w, cur_h;	/* Current size on screen */
+	unsigned int  w, h;		/* Size on screen, after rotation */
+	int           placed;
+};
+
+struct layout {
+	int           num;
+	struct layout_output out[MAX_OUTPUTS];
+};
+
+/* Provider pair from xplugd.conf, see prime.c */
+struct prime {
+	char          source[32];	/* Provider name glob, or index */
+	char          sink[32];
+};
+
+/* Rule from xplugd.conf, see conf.c */
+struct rule;
+
+/* Built-in action, init is called when the rule is read */
+struct action {
+	const char   *name;
+	int         (*init)(Display *dpy, struct rule *r);
+	int         (*run) (Display *dpy, struct rule *r, struct event *ev);
+	void        (*exit)(struct rule *r);
+};
+
+/* What to do with the script for events matching a rule */
+enum verdict {
+	VERDICT_BUILTIN = 0,		/* Built-in action, no verdict */
+	VERDICT_EXEC,			/* Call script */
+	VERDICT_NONE,			/* Do not call script */
+};
+
+struct rule {
+	char          type[16];
+	char          status[16];
+	char          glob[64];
+	int           lineno;
+
+	/* Optional EDID match, displays only */
+	char          vendor[4];
+	char          model[14];
+	unsigned int  serial;
+
+	/* Optional device match, inputs only */
+	unsigned int  usb_vendor;	/* 0: any */
+	unsigned int  usb_product;	/* 0: any */
+	char          node[64];
+	unsigned int  caps;		/* All of XPLUGD_CAP_* */
+
+	enum verdict  verdict;
+	const struct action *action;
+	int           argc;
+	char         *argv[RULE_MAX_ARGS];
+	void         *priv;		/* Prepared by action init */
+
+	struct rule  *next;
+};
 
 extern int loglevel;
 extern char *cmd;
 extern char *prognm;
+extern int multi;
+extern char *conffile;
+extern struct xdisplay *xd;
+
+void notify        (struct event *ev);
+char *config_file  (const char *name);
+
+int  conf_init      (Display *dpy, const char *file);
+void conf_exit      (void);
+int  conf_run       (struct event *ev);
+int  conf_wants     (const char *type);
+const struct prime *conf_prime(int *num);
+int  conf_retrain   (void);
+const struct action *action_find(const char *name);
 
-int exec_init      (Display *dpy);
-int exec           (char *type, char *device, char *status, char *name);
+int  xkb_init       (Display *dpy, struct rule *r);
+int  xkb_run        (Display *dpy, struct rule *r, struct event *ev);
+void xkb_exit       (Display *dpy);
+
+int  seat_init      (Display *dpy, struct rule *r);
+int  seat_run       (Display *dpy, struct rule *r, struct event *ev);
+void seat_flush     (Display *dpy);
+
+int  dpi_init       (Display *dpy, struct rule *r);
+int  dpi_run        (Display *dpy, struct rule *r, struct event *ev);
+int  dpi_size       (const struct xplugd_output *o, int *width, int *height);
+int  dpi_output     (const struct xplugd_output *o, double *scale);
+const struct xplugd_output *dpi_primary(Display *dpy, int scr);
+
+int  gamma_init     (Display *dpy, struct rule *r);
+int  gamma_run      (Display *dpy, struct rule *r, struct event *ev);
+void gamma_exit     (struct rule *r);
+
+int exec_init      (void);
+int exec           (struct event *ev);
+void exec_child    (const char *path, struct event *ev);
+
+int  hook_init     (void);
+void hook_run      (struct event *ev);
 
 int input_init     (Display *dpy);
 int is_input_event (Display *dpy, XEvent *ev);
 int input_event    (Display *dpy, XEvent *ev);
+int input_refresh  (Display *dpy);
+struct xplugd_device *input_devices(int *num);
+struct xplugd_device *input_device (int id);
+char *input_caps      (unsigned int flags, char *buf, size_t len);
+int   input_caps_parse(const char *list, unsigned int *flags);
 
 int randr_init     (Display *dpy);
 int randr_event    (Display *dpy, XEvent *ev);
+int randr_select   (Display *dpy);
 int randr_probe    (Display *dpy);
+int randr_refresh  (Display *dpy, int probe);
+int randr_prewarm  (Display *dpy);
+int randr_providers(Display *dpy);
+void randr_screen_size(Display *dpy, int scr, int *width, int *height);
+struct xplugd_output *randr_outputs(int *num);
+const struct monitor_info *randr_edid(const struct xplugd_output *o);
+
+void link_event    (Display *dpy, int scr, RROutput id);
+void link_exit     (void);
+
+int  prime_apply   (Display *dpy, int scr);
+
+int layout_parse   (const char *spec, struct layout *l);
+int layout_apply   (Display *dpy, int scr, const struct layout *spec);
+int layout_current (Display *dpy, int scr, char *buf, size_t len);
+
+struct xdisplay *display_add  (Display *dpy);
+struct xdisplay *display_open (const char *name);
+void             display_close(struct xdisplay *d);
+struct xdisplay *display_find (Display *dpy);
+struct xdisplay *display_lookup(const char *name);
+struct xdisplay *display_list (void);
+int              display_screen(struct xdisplay *d, int scr, char *buf, size_t len);
+int              display_dispatch(void);
+void             display_reselect(void);
+int              display_watch(const char *dir);
+int              display_local(Display *dpy);
+int              display_reconnect(const char *name);
+
+void  *arena_alloc (size_t len);
+char  *arena_printf(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+size_t arena_used  (void);
+void   arena_reset (void);
+
+int  loop_add      (int fd, void (*cb)(int, void *), void *arg);
+void loop_output   (int fd, int on);
+void loop_del      (int fd);
+int  loop_poll     (int timeout);
+int  loop_timer    (int msec, void (*cb)(void *), void *arg);
+void loop_timer_del(void (*cb)(void *), void *arg);
+
+int  plugin_load    (Display *dpy, const char *path, int argc, char *argv[]);
+int  plugin_run     (struct event *ev);
+
+int      profile_init       (void);
+uint64_t profile_fingerprint(void);
+int      profile_apply      (void);
+int      profile_save       (void);
+
+int uevent_init    (int sd);
+int uevent_is_hotplug (const char *buf, size_t len);
+
+int  sock_init      (void);
+void sock_notify    (struct event *ev);
+int  sock_wants     (const char *type);
+
+int  snapshot_init  (void);
+void snapshot_exit  (void);
+void snapshot_update(void);
+void snapshot_reconcile(void);
+
+int    sysfs_status  (const char *root, const char *output, unsigned int id);
+size_t sysfs_edid    (const char *root, const char *output, unsigned int id, unsigned char *buf, size_t len);
 
 #endif /* XPLUGD_H_ */
 
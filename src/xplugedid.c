@@ -0,0 +1,543 @@
+/* xplugedid - batch EDID decoder and edid_decode() benchmark
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 700		/* nftw() */
+#include "config.h"
+#include <ctype.h>
+#include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "edid.h"
+
+#define MAX_THREADS 256
+#define SYSFS       "/sys"
+
+struct blob {
+	uint64_t             hash;
+	size_t               len;
+	unsigned char       *data;
+	unsigned int         count;	/* Number of identical blobs seen */
+	struct monitor_info *info;
+};
+
+static struct blob **table;		/* Open addressing, keyed by hash */
+static size_t        table_sz;
+static struct blob **blobs;		/* Unique blobs, in order of discovery */
+static size_t        num_blobs;
+static size_t        num_total;
+
+static size_t        next_job;
+static int           rounds = 1;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int           sysfs;		/* Walking /sys, see walk() */
+static int           nested;
+static struct stat  *seen;		/* sysfs files read, by inode */
+static size_t        num_seen;
+
+static char *prognm;
+
+static int grow(void)
+{
+	struct blob **tbl;
+	size_t sz, i;
+
+	sz = table_sz ? table_sz * 2 : 1024;
+	tbl = calloc(sz, sizeof(struct blob *));
+	if (!tbl)
+		return -1;
+
+	for (i = 0; i < num_blobs; i++) {
+		size_t pos = blobs[i]->hash & (sz - 1);
+
+		while (tbl[pos])
+			pos = (pos + 1) & (sz - 1);
+		tbl[pos] = blobs[i];
+	}
+
+	free(table);
+	table = tbl;
+	table_sz = sz;
+
+	tbl = realloc(blobs, sz / 2 * sizeof(struct blob *));
+	if (!tbl)
+		return -1;
+	blobs = tbl;
+
+	return 0;
+}
+
+/*
+ * Add one EDID blob to the corpus, identical blobs are only counted.
+ */
+static int add(const unsigned char *data, size_t len)
+{
+	struct blob *b;
+	uint64_t hash;
+	size_t pos;
+
+	num_total++;
+	if (num_blobs + 1 > table_sz / 2 && grow())
+		return -1;
+
+	hash = edid_hash(data, len);
+	pos = hash & (table_sz - 1);
+	while ((b = table[pos])) {
+		if (b->hash == hash && b->len == len && !memcmp(b->data, data, len)) {
+			b->count++;
+			return 0;
+		}
+		pos = (pos + 1) & (table_sz - 1);
+	}
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return -1;
+
+	b->data = malloc(len);
+	if (!b->data) {
+		free(b);
+		return -1;
+	}
+	memcpy(b->data, data, len);
+	b->len   = len;
+	b->hash  = hash;
+	b->count = 1;
+
+	table[pos] = b;
+	blobs[num_blobs++] = b;
+
+	return 0;
+}
+
+/*
+ * Dumps from xrandr --verbose, edid-decode, etc. are hex text, convert
+ * whitespace separated tokens of hex digits to binary in place.
+ */
+static size_t unhex(unsigned char *buf, size_t len)
+{
+	size_t i = 0, n = 0;
+
+	while (i < len) {
+		size_t start, end;
+
+		while (i < len && isspace(buf[i]))
+			i++;
+		start = i;
+		while (i < len && !isspace(buf[i]))
+			i++;
+		end = i;
+
+		if ((end - start) % 2)
+			continue;
+
+		for (size_t j = start; j < end; j++) {
+			if (!isxdigit(buf[j]))
+				goto next;
+		}
+
+		for (size_t j = start; j < end; j += 2) {
+			char hex[3] = { buf[j], buf[j + 1], 0 };
+
+			buf[n++] = (unsigned char)strtoul(hex, NULL, 16);
+		}
+	next:
+		;
+	}
+
+	return n;
+}
+
+/*
+ * Split a buffer of concatenated EDID blobs, binary or hex text.
+ */
+static int scan(unsigned char *buf, size_t len, const char *name)
+{
+	size_t pos = 0;
+	int found = 0;
+
+	static const unsigned char header[] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+
+	if (len < sizeof(header) || memcmp(buf, header, sizeof(header)))
+		len = unhex(buf, len);
+
+	while (pos + EDID_BLOCK_LEN <= len) {
+		size_t n;
+
+		n = edid_length(&buf[pos], len - pos);
+		if (!n) {
+			pos++;
+			continue;
+		}
+
+		if (add(&buf[pos], n))
+			return -1;
+
+		pos += n;
+		found++;
+	}
+
+	/* A disconnected connector in sysfs has an empty edid */
+	if (!found && !(sysfs && !len))
+		fprintf(stderr, "%s: no EDID found in %s\n", prognm, name);
+
+	return 0;
+}
+
+static int load(FILE *fp, const char *name)
+{
+	unsigned char *buf = NULL;
+	size_t len = 0, sz = 0;
+	int rc;
+
+	while (!feof(fp)) {
+		if (len == sz) {
+			unsigned char *ptr;
+
+			sz = sz ? sz * 2 : 4096;
+			ptr = realloc(buf, sz);
+			if (!ptr) {
+				free(buf);
+				return -1;
+			}
+			buf = ptr;
+		}
+
+		len += fread(&buf[len], 1, sz - len, fp);
+		if (ferror(fp)) {
+			fprintf(stderr, "%s: failed reading %s: %s\n", prognm, name, strerror(errno));
+			free(buf);
+			return 0;
+		}
+	}
+
+	rc = scan(buf, len, name);
+	free(buf);
+
+	return rc;
+}
+
+static int load_file(const char *path)
+{
+	FILE *fp;
+	int rc;
+
+	if (!strcmp(path, "-"))
+		return load(stdin, "stdin");
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "%s: cannot open %s: %s\n", prognm, path, strerror(errno));
+		return 0;
+	}
+
+	rc = load(fp, path);
+	fclose(fp);
+
+	return rc;
+}
+
+/*
+ * A connector in /sys is reached both from its card and from the link
+ * in /sys/class/drm, read each edid once
+ */
+static int once(const struct stat *st)
+{
+	struct stat *ptr;
+	size_t i;
+
+	for (i = 0; i < num_seen; i++) {
+		if (seen[i].st_dev == st->st_dev && seen[i].st_ino == st->st_ino)
+			return 0;
+	}
+
+	ptr = realloc(seen, (num_seen + 1) * sizeof(*seen));
+	if (!ptr)
+		return -1;
+	seen = ptr;
+	seen[num_seen++] = *st;
+
+	return 1;
+}
+
+/*
+ * Everything that is a file is read, sysfs attributes report size 0.
+ * In /sys only the edid attributes are EDID, and /sys/class/drm has
+ * symlinks to the cards and connectors in /sys/devices, which are
+ * followed.  Links further down, e.g. device or subsystem, lead back
+ * up the tree and are not.
+ */
+static int walk(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	if (sysfs && flag == FTW_SL && !nested && ftw->level == 1) {
+		char real[PATH_MAX];
+		struct stat target;
+		int rc;
+
+		if (!realpath(path, real) || stat(real, &target) || !S_ISDIR(target.st_mode))
+			return 0;
+
+		nested = 1;
+		rc = nftw(real, walk, 32, FTW_PHYS);
+		nested = 0;
+
+		return rc;
+	}
+
+	if (flag != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+
+	if (sysfs) {
+		int rc;
+
+		if (strcmp(&path[ftw->base], "edid"))
+			return 0;
+
+		rc = once(st);
+		if (rc < 0) {
+			errno = ENOMEM;
+			return -1;
+		}
+		if (!rc)
+			return 0;
+	}
+
+	if (load_file(path)) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *worker(void *arg)
+{
+	(void)arg;
+
+	while (1) {
+		struct monitor_info *info;
+		struct blob *b;
+		size_t job;
+
+		pthread_mutex_lock(&lock);
+		job = next_job++;
+		pthread_mutex_unlock(&lock);
+
+		if (job >= num_blobs * rounds)
+			break;
+
+		b = blobs[job % num_blobs];
+		info = edid_decode(b->data);
+
+		/* Only keep the result from the last benchmark round */
+		if (job / num_blobs + 1 < (size_t)rounds)
+			free(info);
+		else
+			b->info = info;
+	}
+
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void summary(void)
+{
+	size_t i;
+
+	printf("%-16s %5s %-3s %-6s %-10s %-9s %-17s %3s  %s\n", "HASH", "COUNT", "VID", "PID",
+	       "SERIAL", "SIZE", "PREFERRED", "EXT", "MODEL");
+
+	for (i = 0; i < num_blobs; i++) {
+		struct blob *b = blobs[i];
+		struct monitor_info *info = b->info;
+		char size[24] = "-", timing[40] = "-";
+
+		if (!info) {
+			printf("%016" PRIx64 " %5u %s\n", b->hash, b->count, "(invalid)");
+			continue;
+		}
+
+		if (info->width_mm > 0 && info->height_mm > 0)
+			snprintf(size, sizeof(size), "%dx%d", info->width_mm, info->height_mm);
+
+		if (info->n_detailed_timings > 0) {
+			struct detailed_timing *dt = &info->detailed_timings[0];
+			long total = (long)(dt->h_addr + dt->h_blank) * (dt->v_addr + dt->v_blank);
+
+			snprintf(timing, sizeof(timing), "%dx%d@%.0f", dt->h_addr, dt->v_addr,
+				 total ? (double)dt->pixel_clock / total : 0.0);
+		}
+
+		printf("%016" PRIx64 " %5u %-3s 0x%04x %-10u %-9s %-17s %3zu  %s\n", b->hash, b->count,
+		       info->manufacturer_code, info->product_code, info->serial_number, size, timing,
+		       b->len / EDID_BLOCK_LEN - 1, info->dsc_product_name[0] ? info->dsc_product_name : "-");
+	}
+}
+
+static int usage(int status)
+{
+	printf("Usage: %s [-bhs] [-j NUM] [-r NUM] [PATH ...]\n\n"
+	       "Options:\n"
+	       "  -b        Benchmark mode, report edid_decode() throughput on stderr\n"
+	       "  -h        Print this help text and exit\n"
+	       "  -j NUM    Number of decoder threads, default: number of CPUs\n"
+	       "  -r NUM    Benchmark rounds, decode each unique blob NUM times, default: 1\n"
+	       "  -s        Skip summary table, only useful with -b\n"
+	       "\n"
+	       " PATH       File or directory with raw or hex EDID dumps, may contain\n"
+	       "            several concatenated blobs.  Default: read from stdin\n"
+	       "\n"
+	       "Bug report address: %s\n", prognm, PACKAGE_BUGREPORT);
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t tid[MAX_THREADS];
+	int bench = 0, quiet = 0;
+	long threads;
+	double start;
+	int c, i;
+
+	prognm = strrchr(argv[0], '/');
+	prognm = prognm ? prognm + 1 : argv[0];
+
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "bhj:r:s")) != EOF) {
+		switch (c) {
+		case 'b':
+			bench = 1;
+			break;
+
+		case 'h':
+			return usage(0);
+
+		case 'j':
+			threads = atoi(optarg);
+			break;
+
+		case 'r':
+			rounds = atoi(optarg);
+			if (rounds < 1)
+				return usage(1);
+			break;
+
+		case 's':
+			quiet = 1;
+			break;
+
+		default:
+			return usage(1);
+		}
+	}
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+
+	if (optind == argc) {
+		if (load_file("-"))
+			goto oom;
+	}
+
+	for (i = optind; i < argc; i++) {
+		char path[PATH_MAX];
+		struct stat st;
+
+		if (!strcmp(argv[i], "-") || stat(argv[i], &st) || !S_ISDIR(st.st_mode)) {
+			if (load_file(argv[i]))
+				goto oom;
+			continue;
+		}
+
+		/* Walk the real directory, e.g. /sys/class/drm/card0 is a link */
+		if (!realpath(argv[i], path))
+			snprintf(path, sizeof(path), "%s", argv[i]);
+		sysfs = !strcmp(path, SYSFS) || !strncmp(path, SYSFS "/", sizeof(SYSFS));
+
+		if (nftw(path, walk, 32, FTW_PHYS)) {
+			fprintf(stderr, "%s: failed reading %s: %s\n", prognm, argv[i], strerror(errno));
+			return 1;
+		}
+	}
+
+	/* Jobs are numbered 0 .. num_blobs * rounds */
+	if (num_blobs && (size_t)rounds > SIZE_MAX / num_blobs) {
+		fprintf(stderr, "%s: too many rounds, %d, for %zu blobs\n", prognm, rounds, num_blobs);
+		return 1;
+	}
+
+	start = now();
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&tid[i], NULL, worker, NULL)) {
+			fprintf(stderr, "%s: failed starting thread: %s\n", prognm, strerror(errno));
+			threads = i;
+			break;
+		}
+	}
+	if (!threads)
+		worker(NULL);
+	for (i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+
+	if (bench) {
+		double elapsed = now() - start;
+		double decodes = (double)num_blobs * rounds;
+
+		fprintf(stderr, "%zu blobs, %zu unique, %ld threads, %.0f decodes in %.3f sec, %.0f decodes/sec\n",
+			num_total, num_blobs, threads, decodes, elapsed, elapsed > 0 ? decodes / elapsed : 0.0);
+	}
+
+	if (!quiet)
+		summary();
+
+	return 0;
+oom:
+	fprintf(stderr, "%s: out of memory\n", prognm);
+	return 1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
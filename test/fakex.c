@@ -0,0 +1,892 @@
+/* Fake X server for tests, just enough Xlib, RandR, XInput, and XKB
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Replaces libX11, libXrandr, libXi, and libxkbfile for tests that run
+ * the daemon without an X server.  One screen with a laptop panel and
+ * an HDMI output, and a USB mouse and keyboard, that tests plug in and
+ * out before queueing the events the server would send.
+ *
+ * Everything returned to the daemon is allocated the way the real
+ * libraries do it, one block per reply, so anything the daemon fails
+ * to free, with XFree() or the XRRFree*() functions, shows up as a
+ * leak under LeakSanitizer.  Events are queued on a pipe, which also
+ * makes the display look remote, so sysfs is never consulted.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xrandr.h>
+#include <X11/extensions/XKBrules.h>
+#include "edid.h"
+#include "fakex.h"
+
+#define QLEN        64
+#define MAX_ATOMS   64
+#define FIRST_ATOM  (XA_LAST_PREDEFINED + 1)
+
+#define MODE_LAPTOP  0x80
+#define MODE_MONITOR FAKEX_MONITOR_MODE
+
+struct device {
+	int           id;
+	const char   *name;
+	int           use;
+	int           attachment;
+	int           present;
+};
+
+static struct device devices[] = {
+	{ 2, "Virtual core pointer",         XIMasterPointer,  3, 1 },
+	{ 3, "Virtual core keyboard",        XIMasterKeyboard, 2, 1 },
+	{ 4, "Virtual core XTEST pointer",   XISlavePointer,   2, 1 },
+	{ 5, "Virtual core XTEST keyboard",  XISlaveKeyboard,  3, 1 },
+	{ FAKEX_MOUSE,    "USB Optical Mouse", XISlavePointer,  2, 0 },
+	{ FAKEX_KEYBOARD, "USB Keyboard",      XISlaveKeyboard, 3, 0 },
+};
+
+/* Atoms the server has, XInternAtom() with only_if_exists finds these */
+static const char *server_atoms[] = {
+	RR_PROPERTY_RANDR_EDID,
+	"Device Product ID",
+	"Device Node",
+	"libinput Tapping Enabled",
+	NULL
+};
+
+static char atoms[MAX_ATOMS][64];
+static int num_atoms;
+
+static _XPrivDisplay display;
+static Screen screen;
+static int screen_w, screen_h;		/* Server side, Xlib's is in screen */
+static int pipefd[2] = { -1, -1 };
+
+static XEvent queue[QLEN];
+static int head, count;
+
+static int plugged;
+static unsigned char edid[2][EDID_BLOCK_LEN];
+
+/* Cheaper than the real thing, header, vendor DEL, model name, checksum */
+static void edid_build(unsigned char *buf, int serial, const char *model)
+{
+	static const unsigned char header[] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+	unsigned char sum = 0;
+	unsigned char *desc;
+	int i;
+
+	memset(buf, 0, EDID_BLOCK_LEN);
+	memcpy(buf, header, sizeof(header));
+	buf[0x08] = 0x10;		/* DEL */
+	buf[0x09] = 0xac;
+	buf[0x0a] = 0xb1;
+	buf[0x0b] = 0xa0;
+	buf[0x0c] = serial;
+	buf[0x0d] = serial >> 8;
+	buf[0x12] = 1;			/* EDID 1.4 */
+	buf[0x13] = 4;
+	buf[0x17] = 120;		/* Gamma 2.2 */
+
+	desc = &buf[0x36];
+	desc[3] = 0xfc;
+	snprintf((char *)&desc[5], 14, "%s\n", model);
+	for (i = 1; i < 4; i++)
+		buf[0x36 + i * 18 + 3] = 0x10;	/* Dummy descriptor */
+
+	for (i = 0; i < EDID_BLOCK_LEN - 1; i++)
+		sum += buf[i];
+	buf[EDID_BLOCK_LEN - 1] = -sum;
+}
+
+/*
+ * Connect, or disconnect, HDMI-1.  Each @monitor is a different EDID,
+ * so a test can cycle the daemon's EDID cache.
+ */
+void fakex_plug(int on, int monitor)
+{
+	char model[16];
+
+	plugged = on;
+	snprintf(model, sizeof(model), "Monitor %d", monitor);
+	edid_build(edid[1], monitor, model);
+}
+
+void fakex_device(int id, int on)
+{
+	for (size_t i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
+		if (devices[i].id == id)
+			devices[i].present = on;
+	}
+}
+
+/*
+ * Queue an event, it is read by the daemon the next time it polls
+ */
+void fakex_queue(XEvent *ev)
+{
+	if (count >= QLEN) {
+		fprintf(stderr, "fakex: event queue full\n");
+		exit(1);
+	}
+
+	queue[(head + count++) % QLEN] = *ev;
+	if (write(pipefd[1], "", 1) == -1 && errno != EAGAIN) {
+		perror("fakex: write");
+		exit(1);
+	}
+}
+
+static Atom atom_find(const char *name)
+{
+	for (int i = 0; i < num_atoms; i++) {
+		if (!strcmp(atoms[i], name))
+			return FIRST_ATOM + i;
+	}
+
+	return None;
+}
+
+static Atom atom_add(const char *name)
+{
+	if (num_atoms >= MAX_ATOMS) {
+		fprintf(stderr, "fakex: too many atoms\n");
+		exit(1);
+	}
+	snprintf(atoms[num_atoms], sizeof(atoms[0]), "%s", name);
+
+	return FIRST_ATOM + num_atoms++;
+}
+
+Atom fakex_atom(const char *name)
+{
+	return atom_find(name);
+}
+
+void fakex_screen(int *width, int *height)
+{
+	*width  = screen_w;
+	*height = screen_h;
+}
+
+/*
+ * Xlib
+ */
+Display *XOpenDisplay(const char *name)
+{
+	if (display)
+		return NULL;
+
+	if (pipe(pipefd))
+		return NULL;
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
+
+	for (int i = 0; server_atoms[i]; i++)
+		atom_add(server_atoms[i]);
+	edid_build(edid[0], 1, "Laptop panel");
+	fakex_plug(0, 0);
+
+	display = calloc(1, sizeof(*display));
+	if (!display)
+		return NULL;
+
+	screen.display = (Display *)display;
+	screen.root    = FAKEX_ROOT;
+	screen.width   = 1920;
+	screen.height  = 1080;
+	screen.mwidth  = 508;
+	screen.mheight = 285;
+	screen_w       = screen.width;
+	screen_h       = screen.height;
+
+	display->fd             = pipefd[0];
+	display->display_name   = ":fake";
+	display->screens        = &screen;
+	display->nscreens       = 1;
+	display->default_screen = 0;
+
+	return (Display *)display;
+}
+
+int XCloseDisplay(Display *dpy)
+{
+	close(pipefd[0]);
+	close(pipefd[1]);
+	free(display);
+	display = NULL;
+
+	return 0;
+}
+
+char *XDisplayName(const char *name)
+{
+	return (char *)(name ? name : ":fake");
+}
+
+int XPending(Display *dpy)
+{
+	char buf[QLEN];
+
+	while (read(pipefd[0], buf, sizeof(buf)) > 0)
+		;
+
+	return count;
+}
+
+int XQLength(Display *dpy)
+{
+	return count;
+}
+
+int XNextEvent(Display *dpy, XEvent *ev)
+{
+	if (!count) {
+		fprintf(stderr, "fakex: XNextEvent() would block\n");
+		exit(1);
+	}
+
+	*ev = queue[head];
+	head = (head + 1) % QLEN;
+	count--;
+
+	return 0;
+}
+
+int XSync(Display *dpy, Bool discard)
+{
+	return 1;
+}
+
+int XFlush(Display *dpy)
+{
+	return 1;
+}
+
+Status XGetGeometry(Display *dpy, Drawable d, Window *root, int *x, int *y, unsigned int *width,
+		    unsigned int *height, unsigned int *border, unsigned int *depth)
+{
+	*root   = FAKEX_ROOT;
+	*x      = *y = 0;
+	*width  = screen_w;
+	*height = screen_h;
+	*border = 0;
+	*depth  = 24;
+
+	return 1;
+}
+
+int XGrabServer(Display *dpy)
+{
+	return 1;
+}
+
+int XUngrabServer(Display *dpy)
+{
+	return 1;
+}
+
+int XFree(void *data)
+{
+	free(data);
+	return 1;
+}
+
+Atom XInternAtom(Display *dpy, const char *name, Bool only_if_exists)
+{
+	Atom atom = atom_find(name);
+
+	if (atom == None && !only_if_exists)
+		atom = atom_add(name);
+
+	return atom;
+}
+
+char *XGetAtomName(Display *dpy, Atom atom)
+{
+	if (atom < FIRST_ATOM || atom >= (Atom)(FIRST_ATOM + num_atoms))
+		return NULL;
+
+	return strdup(atoms[atom - FIRST_ATOM]);
+}
+
+int XGetWindowProperty(Display *dpy, Window w, Atom property, long offset, long length, Bool delete,
+		       Atom req_type, Atom *type, int *format, unsigned long *nitems,
+		       unsigned long *bytes_after, unsigned char **data)
+{
+	*type        = None;
+	*format      = 0;
+	*nitems      = 0;
+	*bytes_after = 0;
+	*data        = NULL;
+
+	return Success;
+}
+
+int XChangeProperty(Display *dpy, Window w, Atom property, Atom type, int format, int mode,
+		    const unsigned char *data, int nelements)
+{
+	return 1;
+}
+
+int XGetErrorText(Display *dpy, int code, char *buf, int len)
+{
+	snprintf(buf, len, "error %d", code);
+	return 0;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler)
+{
+	return NULL;
+}
+
+XIOErrorHandler XSetIOErrorHandler(XIOErrorHandler handler)
+{
+	return NULL;
+}
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+void XSetIOErrorExitHandler(Display *dpy, XIOErrorExitHandler handler, void *arg)
+{
+}
+#endif
+
+Bool XQueryExtension(Display *dpy, const char *name, int *opcode, int *event, int *error)
+{
+	if (strcmp(name, "XInputExtension"))
+		return False;
+
+	*opcode = FAKEX_XI_OPCODE;
+	*event  = 0;
+	*error  = 0;
+
+	return True;
+}
+
+/*
+ * Hierarchy events are queued with their data, as if already read
+ */
+Bool XGetEventData(Display *dpy, XGenericEventCookie *cookie)
+{
+	return cookie->type == GenericEvent && cookie->data;
+}
+
+void XFreeEventData(Display *dpy, XGenericEventCookie *cookie)
+{
+	if (cookie->type != GenericEvent)
+		return;
+
+	free(cookie->data);
+	cookie->data = NULL;
+}
+
+/*
+ * RandR
+ */
+Bool XRRQueryExtension(Display *dpy, int *event_base, int *error_base)
+{
+	*event_base = FAKEX_RR_EVENT_BASE;
+	*error_base = 0;
+
+	return True;
+}
+
+Status XRRQueryVersion(Display *dpy, int *major, int *minor)
+{
+	*major = 1;
+	*minor = 6;
+
+	return 1;
+}
+
+void XRRSelectInput(Display *dpy, Window window, int mask)
+{
+}
+
+int XRRUpdateConfiguration(XEvent *event)
+{
+	return 1;
+}
+
+static XRRScreenResources *resources(void)
+{
+	XRRScreenResources *res;
+	char *p;
+
+	p = calloc(1, sizeof(*res) + 2 * sizeof(RRCrtc) + 2 * sizeof(RROutput) + 2 * sizeof(XRRModeInfo));
+	if (!p)
+		return NULL;
+
+	res = (XRRScreenResources *)p;
+	p += sizeof(*res);
+	res->crtcs = (RRCrtc *)p;
+	p += 2 * sizeof(RRCrtc);
+	res->outputs = (RROutput *)p;
+	p += 2 * sizeof(RROutput);
+	res->modes = (XRRModeInfo *)p;
+
+	res->ncrtc      = 2;
+	res->crtcs[0]   = FAKEX_LAPTOP_CRTC;
+	res->crtcs[1]   = FAKEX_MONITOR_CRTC;
+	res->noutput    = 2;
+	res->outputs[0] = FAKEX_LAPTOP;
+	res->outputs[1] = FAKEX_MONITOR;
+	res->nmode      = 2;
+	res->modes[0]   = (XRRModeInfo){ .id = MODE_LAPTOP,  .width = 1920, .height = 1080,
+				       .dotClock = 148500000, .hTotal = 2200, .vTotal = 1125 };
+	res->modes[1]   = (XRRModeInfo){ .id = MODE_MONITOR, .width = 2560, .height = 1440,
+				       .dotClock = 241500000, .hTotal = 2720, .vTotal = 1481 };
+
+	return res;
+}
+
+XRRScreenResources *XRRGetScreenResources(Display *dpy, Window window)
+{
+	return resources();
+}
+
+XRRScreenResources *XRRGetScreenResourcesCurrent(Display *dpy, Window window)
+{
+	return resources();
+}
+
+void XRRFreeScreenResources(XRRScreenResources *res)
+{
+	free(res);
+}
+
+XRROutputInfo *XRRGetOutputInfo(Display *dpy, XRRScreenResources *res, RROutput output)
+{
+	int laptop = output == FAKEX_LAPTOP;
+	const char *name = laptop ? "eDP-1" : "HDMI-1";
+	XRROutputInfo *info;
+	char *p;
+
+	if (output != FAKEX_LAPTOP && output != FAKEX_MONITOR)
+		return NULL;
+
+	p = calloc(1, sizeof(*info) + sizeof(RRCrtc) + sizeof(RRMode) + strlen(name) + 1);
+	if (!p)
+		return NULL;
+
+	info = (XRROutputInfo *)p;
+	p += sizeof(*info);
+	info->crtcs = (RRCrtc *)p;
+	p += sizeof(RRCrtc);
+	info->modes = (RRMode *)p;
+	p += sizeof(RRMode);
+	info->name = p;
+	strcpy(info->name, name);
+	info->nameLen = strlen(name);
+
+	info->ncrtc      = 1;
+	info->crtcs[0]   = laptop ? FAKEX_LAPTOP_CRTC : FAKEX_MONITOR_CRTC;
+	info->connection = laptop || plugged ? RR_Connected : RR_Disconnected;
+	if (info->connection == RR_Connected) {
+		info->crtc       = info->crtcs[0];
+		info->nmode      = 1;
+		info->npreferred = 1;
+		info->modes[0]   = laptop ? MODE_LAPTOP : MODE_MONITOR;
+		info->mm_width   = laptop ? 310 : 600;
+		info->mm_height  = laptop ? 174 : 340;
+	}
+
+	return info;
+}
+
+void XRRFreeOutputInfo(XRROutputInfo *info)
+{
+	free(info);
+}
+
+XRRCrtcInfo *XRRGetCrtcInfo(Display *dpy, XRRScreenResources *res, RRCrtc crtc)
+{
+	int laptop = crtc == FAKEX_LAPTOP_CRTC;
+	XRRCrtcInfo *ci;
+
+	if (crtc != FAKEX_LAPTOP_CRTC && crtc != FAKEX_MONITOR_CRTC)
+		return NULL;
+
+	ci = calloc(1, sizeof(*ci) + 2 * sizeof(RROutput));
+	if (!ci)
+		return NULL;
+
+	ci->outputs    = (RROutput *)(ci + 1);
+	ci->possible   = ci->outputs + 1;
+	ci->npossible  = 1;
+	ci->possible[0] = laptop ? FAKEX_LAPTOP : FAKEX_MONITOR;
+	ci->rotations  = RR_Rotate_0;
+	ci->rotation   = RR_Rotate_0;
+	if (laptop || plugged) {
+		ci->noutput    = 1;
+		ci->outputs[0] = ci->possible[0];
+		ci->mode       = laptop ? MODE_LAPTOP : MODE_MONITOR;
+		ci->x          = laptop ? 0 : 1920;
+		ci->width      = laptop ? 1920 : 2560;
+		ci->height     = laptop ? 1080 : 1440;
+	}
+
+	return ci;
+}
+
+void XRRFreeCrtcInfo(XRRCrtcInfo *ci)
+{
+	free(ci);
+}
+
+Status XRRSetCrtcConfig(Display *dpy, XRRScreenResources *res, RRCrtc crtc, Time timestamp, int x, int y,
+			RRMode mode, Rotation rotation, RROutput *outputs, int noutputs)
+{
+	return RRSetConfigSuccess;
+}
+
+Status XRRGetScreenSizeRange(Display *dpy, Window window, int *min_w, int *min_h, int *max_w, int *max_h)
+{
+	*min_w = 320;
+	*min_h = 200;
+	*max_w = 8192;
+	*max_h = 8192;
+
+	return 1;
+}
+
+void XRRSetScreenSize(Display *dpy, Window window, int width, int height, int mm_width, int mm_height)
+{
+	/* Like the real thing, Xlib's view only changes on screen events */
+	screen_w = width;
+	screen_h = height;
+}
+
+RROutput XRRGetOutputPrimary(Display *dpy, Window window)
+{
+	return FAKEX_LAPTOP;
+}
+
+void XRRSetOutputPrimary(Display *dpy, Window window, RROutput output)
+{
+}
+
+int XRRGetOutputProperty(Display *dpy, RROutput output, Atom property, long offset, long length,
+			 Bool delete, Bool pending, Atom req_type, Atom *type, int *format,
+			 unsigned long *nitems, unsigned long *bytes_after, unsigned char **data)
+{
+	int laptop = output == FAKEX_LAPTOP;
+
+	*type        = None;
+	*format      = 0;
+	*nitems      = 0;
+	*bytes_after = 0;
+	*data        = NULL;
+
+	if (property != atom_find(RR_PROPERTY_RANDR_EDID) || (!laptop && !plugged))
+		return Success;
+
+	*data = malloc(EDID_BLOCK_LEN);
+	if (!*data)
+		return BadAlloc;
+
+	memcpy(*data, edid[!laptop], EDID_BLOCK_LEN);
+	*type   = XA_INTEGER;
+	*format = 8;
+	*nitems = EDID_BLOCK_LEN;
+
+	return Success;
+}
+
+int XRRGetCrtcGammaSize(Display *dpy, RRCrtc crtc)
+{
+	return 256;
+}
+
+XRRCrtcGamma *XRRAllocGamma(int size)
+{
+	XRRCrtcGamma *gamma;
+
+	gamma = calloc(1, sizeof(*gamma) + 3 * size * sizeof(unsigned short));
+	if (!gamma)
+		return NULL;
+
+	gamma->size  = size;
+	gamma->red   = (unsigned short *)(gamma + 1);
+	gamma->green = gamma->red + size;
+	gamma->blue  = gamma->green + size;
+
+	return gamma;
+}
+
+void XRRSetCrtcGamma(Display *dpy, RRCrtc crtc, XRRCrtcGamma *gamma)
+{
+}
+
+void XRRFreeGamma(XRRCrtcGamma *gamma)
+{
+	free(gamma);
+}
+
+/* No GPU providers, PRIME is not tested here */
+XRRProviderResources *XRRGetProviderResources(Display *dpy, Window window)
+{
+	return calloc(1, sizeof(XRRProviderResources));
+}
+
+void XRRFreeProviderResources(XRRProviderResources *res)
+{
+	free(res);
+}
+
+XRRProviderInfo *XRRGetProviderInfo(Display *dpy, XRRScreenResources *res, RRProvider provider)
+{
+	return NULL;
+}
+
+void XRRFreeProviderInfo(XRRProviderInfo *info)
+{
+	free(info);
+}
+
+int XRRSetProviderOutputSource(Display *dpy, XID provider, XID source)
+{
+	return 0;
+}
+
+/*
+ * XInput
+ */
+int XISelectEvents(Display *dpy, Window win, XIEventMask *masks, int num_masks)
+{
+	return Success;
+}
+
+/*
+ * Like libXi, the list ends with an entry without name, and each
+ * device has its classes in one block
+ */
+static int device_info(XIDeviceInfo *info, const struct device *dev)
+{
+	XIButtonClassInfo *button;
+	XIKeyClassInfo *key;
+	void **classes;
+
+	info->deviceid   = dev->id;
+	info->use        = dev->use;
+	info->attachment = dev->attachment;
+	info->enabled    = True;
+	info->name       = strdup(dev->name);
+
+	classes = calloc(1, 2 * sizeof(void *) + sizeof(*button) + sizeof(*key));
+	if (!info->name || !classes) {
+		free(info->name);
+		free(classes);
+		return -1;
+	}
+
+	button = (XIButtonClassInfo *)&classes[2];
+	key    = (XIKeyClassInfo *)(button + 1);
+	button->type = XIButtonClass;
+	key->type    = XIKeyClass;
+
+	info->classes     = (XIAnyClassInfo **)classes;
+	info->num_classes = 1;
+	if (dev->use == XISlavePointer || dev->use == XIMasterPointer)
+		classes[0] = button;
+	else
+		classes[0] = key;
+
+	return 0;
+}
+
+XIDeviceInfo *XIQueryDevice(Display *dpy, int id, int *num)
+{
+	size_t max = sizeof(devices) / sizeof(devices[0]);
+	XIDeviceInfo *info;
+	size_t i;
+
+	*num = 0;
+	info = calloc(max + 1, sizeof(*info));
+	if (!info)
+		return NULL;
+
+	for (i = 0; i < max; i++) {
+		if (!devices[i].present || (id != XIAllDevices && id != devices[i].id))
+			continue;
+
+		if (device_info(&info[*num], &devices[i])) {
+			XIFreeDeviceInfo(info);
+			return NULL;
+		}
+		(*num)++;
+	}
+
+	if (!*num) {
+		free(info);
+		return NULL;
+	}
+
+	return info;
+}
+
+void XIFreeDeviceInfo(XIDeviceInfo *info)
+{
+	if (!info)
+		return;
+
+	for (XIDeviceInfo *p = info; p->name; p++) {
+		free(p->classes);
+		free(p->name);
+	}
+	free(info);
+}
+
+Status XIGetProperty(Display *dpy, int id, Atom property, long offset, long length, Bool delete,
+		     Atom req_type, Atom *type, int *format, unsigned long *nitems,
+		     unsigned long *bytes_after, unsigned char **data)
+{
+	*type        = None;
+	*format      = 0;
+	*nitems      = 0;
+	*bytes_after = 0;
+	*data        = NULL;
+
+	if (id != FAKEX_MOUSE && id != FAKEX_KEYBOARD)
+		return Success;
+
+	if (property == atom_find("Device Product ID")) {
+		int32_t *ids = malloc(2 * sizeof(int32_t));
+
+		if (!ids)
+			return BadAlloc;
+		ids[0] = 0x046d;
+		ids[1] = id == FAKEX_MOUSE ? 0xc077 : 0xc31c;
+
+		*type   = XA_INTEGER;
+		*format = 32;
+		*nitems = 2;
+		*data   = (unsigned char *)ids;
+	} else if (property == atom_find("Device Node")) {
+		char node[32];
+
+		snprintf(node, sizeof(node), "/dev/input/event%d", id);
+		*data = (unsigned char *)strdup(node);
+		if (!*data)
+			return BadAlloc;
+
+		*type   = XA_STRING;
+		*format = 8;
+		*nitems = strlen(node);
+	} else if (property == atom_find("libinput Tapping Enabled")) {
+		/* Type and format only, like a zero length request */
+		*data = malloc(1);
+		if (!*data)
+			return BadAlloc;
+
+		*type   = XA_INTEGER;
+		*format = 8;
+		*bytes_after = 1;
+	}
+
+	return Success;
+}
+
+void XIChangeProperty(Display *dpy, int id, Atom property, Atom type, int format, int mode,
+		      unsigned char *data, int num_items)
+{
+}
+
+Status XIChangeHierarchy(Display *dpy, XIAnyHierarchyChangeInfo *changes, int num_changes)
+{
+	return Success;
+}
+
+/*
+ * XKB, the keymap is never looked at, only allocated and freed
+ */
+Bool XkbQueryExtension(Display *dpy, int *opcode, int *event, int *error, int *major, int *minor)
+{
+	return True;
+}
+
+Bool XkbRF_GetNamesProp(Display *dpy, char **rules, XkbRF_VarDefsPtr vd)
+{
+	*rules     = strdup("evdev");
+	vd->model  = strdup("pc105");
+	vd->layout = strdup("us");
+
+	return True;
+}
+
+XkbRF_RulesPtr XkbRF_Load(char *base, char *locale, Bool want_desc, Bool want_rules)
+{
+	return (XkbRF_RulesPtr)malloc(1);
+}
+
+void XkbRF_Free(XkbRF_RulesPtr rules, Bool free_rules)
+{
+	free(rules);
+}
+
+Bool XkbRF_GetComponents(XkbRF_RulesPtr rules, XkbRF_VarDefsPtr vd, XkbComponentNamesPtr names)
+{
+	names->keycodes = strdup("evdev+aliases(qwerty)");
+	names->types    = strdup("complete");
+	names->compat   = strdup("complete");
+	names->symbols  = strdup("pc+us+inet(evdev)");
+
+	return True;
+}
+
+XkbDescPtr XkbGetKeyboardByName(Display *dpy, unsigned int spec, XkbComponentNamesPtr names,
+				unsigned int want, unsigned int need, Bool load)
+{
+	return calloc(1, sizeof(XkbDescRec));
+}
+
+void XkbFreeKeyboard(XkbDescPtr xkb, unsigned int which, Bool free_desc)
+{
+	free(xkb);
+}
+
+Bool XkbSetMap(Display *dpy, unsigned int which, XkbDescPtr xkb)
+{
+	return True;
+}
+
+Bool XkbSetCompatMap(Display *dpy, unsigned int which, XkbDescPtr xkb, Bool update_actions)
+{
+	return True;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,46 @@
+/* Fake X server for tests, just enough Xlib, RandR, XInput, and XKB
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef XPLUGD_FAKEX_H_
+#define XPLUGD_FAKEX_H_
+
+#include <X11/Xlib.h>
+
+#define FAKEX_RR_EVENT_BASE 89
+#define FAKEX_XI_OPCODE     131
+
+#define FAKEX_ROOT          0x100
+#define FAKEX_LAPTOP        0x40	/* eDP-1, always connected */
+#define FAKEX_MONITOR       0x41	/* HDMI-1, see fakex_plug() */
+#define FAKEX_LAPTOP_CRTC   0x60
+#define FAKEX_MONITOR_CRTC  0x61
+#define FAKEX_MONITOR_MODE  0x81	/* 2560x1440 */
+#define FAKEX_MOUSE         10		/* USB mouse and keyboard, */
+#define FAKEX_KEYBOARD      11		/* see fakex_device() */
+
+void fakex_plug   (int on, int monitor);
+void fakex_device (int id, int on);
+void fakex_queue  (XEvent *ev);
+Atom fakex_atom   (const char *name);
+void fakex_screen (int *width, int *height);
+
+#endif /* XPLUGD_FAKEX_H_ */
@@ -0,0 +1,87 @@
+/* Test the RandR layout applier against the fake X server
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Docks and undocks, and checks the screen size the server ends up
+ * with.  The fake server, like a real one, only updates Xlib's idea of
+ * the screen size on screen events, which are not selected here.
+ */
+
+#include "xplugd.h"
+#include "fakex.h"
+
+#define check(cond) do {						\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			failed++;					\
+		}							\
+	} while (0)
+
+static int failed;
+
+static void apply(Display *dpy, const char *spec, int width, int height)
+{
+	struct layout l;
+	int w, h;
+
+	check(layout_parse(spec, &l) == 0);
+	check(layout_apply(dpy, 0, &l) == 0);
+
+	fakex_screen(&w, &h);
+	if (w != width || h != height)
+		fprintf(stderr, "%s: screen %dx%d, expected %dx%d\n", spec, w, h, width, height);
+	check(w == width && h == height);
+}
+
+int main(void)
+{
+	Display *dpy;
+
+	prognm   = "layout";
+	loglevel = LOG_WARNING;
+	openlog(prognm, LOG_PERROR, LOG_USER);
+	setlogmask(LOG_UPTO(loglevel));
+
+	dpy = XOpenDisplay(NULL);
+	if (!dpy || !display_add(dpy)) {
+		fprintf(stderr, "Failed setting up the fake display\n");
+		return 1;
+	}
+
+	fakex_plug(1, 1);
+	apply(dpy, "eDP-1; HDMI-1 right-of eDP-1", 4480, 1440);
+	fakex_plug(0, 1);
+	apply(dpy, "eDP-1; HDMI-1 off", 1920, 1080);
+	fakex_plug(1, 1);
+	apply(dpy, "eDP-1; HDMI-1 right-of eDP-1", 4480, 1440);
+
+	display_close(display_find(dpy));
+
+	return failed ? 1 : 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,82 @@
+/* Test xplugd -p, probing outputs with no display set up
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs main() with -p against the fake X server in fakex.c.  Probing
+ * reads EDID for each connected output before, and without, any call
+ * to display_add(), so nothing on the way may use the current display.
+ */
+
+#include "xplugd.h"
+#include "fakex.h"
+
+#define check(cond) do {						\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			failed++;					\
+		}							\
+	} while (0)
+
+int xplugd_main(int argc, char *argv[]);
+
+int main(void)
+{
+	char *argv[] = { "xplugd", "-p", NULL };
+	char buf[4096];
+	int failed = 0;
+	int fd, rc;
+	size_t len;
+	FILE *fp;
+
+	fp = tmpfile();
+	if (!fp)
+		return 1;
+
+	/* Probe output goes to stdout, keep it for checking */
+	fflush(stdout);
+	fd = dup(STDOUT_FILENO);
+	dup2(fileno(fp), STDOUT_FILENO);
+	rc = xplugd_main(2, argv);
+	fflush(stdout);
+	dup2(fd, STDOUT_FILENO);
+	close(fd);
+
+	rewind(fp);
+	len = fread(buf, 1, sizeof(buf) - 1, fp);
+	buf[len] = 0;
+	fclose(fp);
+	fputs(buf, stdout);
+
+	check(rc == 0);
+	check(display_list() == NULL);
+	check(strstr(buf, "eDP-1\n") != NULL);
+	check(strstr(buf, "Laptop panel") != NULL);
+
+	return failed ? 1 : 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,428 @@
+/* Soak test, the daemon handles many synthetic events with flat RSS
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs the daemon's modules, its main loop, rules, socket, snapshot,
+ * and layout profiles, against the fake X server in fakex.c.  Monitors
+ * and input devices are plugged in and out until EVENTS events have
+ * been handled, with one socket client that reads every frame and one
+ * that never does, and is dropped, over and over.  The per-event arena
+ * must be empty again after each event.
+ *
+ * RSS is sampled after WARMUP events, when all caches are full, and at
+ * the end.  It must not grow by more than SLACK.  The test is built
+ * twice: soak runs under ASan and LSan, if the compiler has them, and
+ * any memory not freed at exit, or used after free on the way, fails
+ * it.  soak-rss runs without them.  ASan recycles freed memory through
+ * its quarantine into new pages, RSS grows steadily even when the live
+ * heap is flat to the byte, so under ASan the heap is checked instead.
+ */
+
+#define _XOPEN_SOURCE 700		/* nftw() */
+#include <ftw.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "xplugd.h"
+#include "fakex.h"
+
+#define EVENTS  100000
+#define WARMUP  50000
+#define STEPS   14
+
+#if defined(__SANITIZE_ADDRESS__)
+#define ASAN    1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ASAN    1
+#endif
+#endif
+
+#ifdef ASAN
+#define HEAP_SLACK  4096
+size_t __sanitizer_get_current_allocated_bytes(void);
+#else
+#define SLACK       (128 * 1024)
+#endif
+
+#define RULES								\
+	"pointer  connected \"USB Optical Mouse\" set-prop \"libinput Tapping Enabled\" 1\n" \
+	"pointer  connected \"USB Optical Mouse\" map-to-output HDMI-1\n" \
+	"keyboard connected *                   xkb layout=us options=ctrl:nocaps\n" \
+	"display  connected *                   dpi\n"			\
+	"display  connected *                   gamma\n"
+
+static char dir[64];
+static char sockpath[108];
+static Display *dpy;
+
+#ifdef ASAN
+/*
+ * A small quarantine, or freed memory kept to catch use-after-free
+ * would count as RSS growth
+ */
+const char *__asan_default_options(void)
+{
+	return "quarantine_size_mb=1:detect_leaks=1";
+}
+
+static long heap(void)
+{
+	return __sanitizer_get_current_allocated_bytes();
+}
+#else
+static long heap(void)
+{
+	return 0;
+}
+#endif
+
+static long rss(void)
+{
+	long pages = 0, resident = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		return 0;
+	if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(fp);
+
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static int client(const char *cmd)
+{
+	struct sockaddr_un sa = { .sun_family = AF_UNIX };
+	int sd;
+
+	sd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+	if (sd == -1)
+		return -1;
+
+	snprintf(sa.sun_path, sizeof(sa.sun_path), "%s", sockpath);
+	if (connect(sd, (struct sockaddr *)&sa, sizeof(sa)) || send(sd, cmd, strlen(cmd), 0) == -1) {
+		close(sd);
+		return -1;
+	}
+
+	return sd;
+}
+
+static void drain(int sd)
+{
+	char buf[SOCK_FRAME_LEN];
+
+	while (recv(sd, buf, sizeof(buf), 0) > 0)
+		;
+}
+
+static void randr(int subtype, XID id, int on)
+{
+	XEvent ev;
+
+	memset(&ev, 0, sizeof(ev));
+	if (subtype == RRScreenChangeNotify) {
+		XRRScreenChangeNotifyEvent *sc = (XRRScreenChangeNotifyEvent *)&ev;
+
+		sc->type   = FAKEX_RR_EVENT_BASE + RRScreenChangeNotify;
+		sc->window = sc->root = FAKEX_ROOT;
+		sc->width  = on ? 1920 + 2560 : 1920;
+		sc->height = on ? 1440 : 1080;
+	} else {
+		XRRNotifyEvent *rn = (XRRNotifyEvent *)&ev;
+
+		rn->type    = FAKEX_RR_EVENT_BASE + RRNotify;
+		rn->window  = FAKEX_ROOT;
+		rn->subtype = subtype;
+	}
+	ev.xany.display = dpy;
+
+	switch (subtype) {
+	case RRNotify_OutputChange: {
+		XRROutputChangeNotifyEvent *oc = (XRROutputChangeNotifyEvent *)&ev;
+
+		oc->output     = id;
+		oc->crtc       = on ? FAKEX_MONITOR_CRTC : None;
+		oc->connection = on ? RR_Connected : RR_Disconnected;
+		break;
+	}
+
+	case RRNotify_CrtcChange: {
+		XRRCrtcChangeNotifyEvent *cc = (XRRCrtcChangeNotifyEvent *)&ev;
+
+		cc->crtc = id;
+		if (on) {
+			cc->mode   = FAKEX_MONITOR_MODE;
+			cc->x      = 1920;
+			cc->width  = 2560;
+			cc->height = 1440;
+		}
+		break;
+	}
+
+	case RRNotify_OutputProperty: {
+		XRROutputPropertyNotifyEvent *op = (XRROutputPropertyNotifyEvent *)&ev;
+
+		op->output   = id;
+		op->property = fakex_atom(RR_PROPERTY_RANDR_EDID);
+		op->state    = PropertyNewValue;
+		break;
+	}
+	}
+
+	fakex_queue(&ev);
+}
+
+/*
+ * Like Xlib, the hierarchy info is in the same block as the event.  The
+ * server sends separate events for adding and enabling a device.
+ */
+static void hierarchy(int id, int use, int flags)
+{
+	XIHierarchyEvent *he;
+	XEvent ev;
+
+	he = calloc(1, sizeof(*he) + sizeof(XIHierarchyInfo));
+	if (!he)
+		return;
+
+	he->type      = GenericEvent;
+	he->display   = dpy;
+	he->extension = FAKEX_XI_OPCODE;
+	he->evtype    = XI_HierarchyChanged;
+	he->flags     = flags;
+	he->num_info  = 1;
+	he->info      = (XIHierarchyInfo *)(he + 1);
+	he->info[0]   = (XIHierarchyInfo) {
+		.deviceid   = id,
+		.attachment = use == XISlavePointer ? 2 : 3,
+		.use        = use,
+		.enabled    = !(flags & (XIDeviceDisabled | XISlaveRemoved)),
+		.flags      = flags,
+	};
+
+	memset(&ev, 0, sizeof(ev));
+	ev.xcookie.type      = GenericEvent;
+	ev.xcookie.display   = dpy;
+	ev.xcookie.extension = FAKEX_XI_OPCODE;
+	ev.xcookie.evtype    = XI_HierarchyChanged;
+	ev.xcookie.data      = he;
+
+	if (flags & XISlaveAdded)
+		fakex_device(id, 1);
+	if (flags & XISlaveRemoved)
+		fakex_device(id, 0);
+	fakex_queue(&ev);
+}
+
+/*
+ * One of the STEPS steps of plugging in a monitor, mouse and keyboard,
+ * and unplugging them again.  Every cycle has a new monitor, until
+ * the EDID cache has seen them all.
+ */
+static void step(int n)
+{
+	int cycle = n / STEPS;
+
+	switch (n % STEPS) {
+	case 0:
+		fakex_plug(1, cycle % (2 * EDID_CACHE_SIZE));
+		randr(RRNotify_OutputChange, FAKEX_MONITOR, 1);
+		break;
+	case 1:
+		randr(RRNotify_CrtcChange, FAKEX_MONITOR_CRTC, 1);
+		break;
+	case 2:
+		randr(RRNotify_OutputProperty, FAKEX_MONITOR, 1);
+		break;
+	case 3:
+		hierarchy(FAKEX_MOUSE, XISlavePointer, XISlaveAdded);
+		break;
+	case 4:
+		hierarchy(FAKEX_MOUSE, XISlavePointer, XIDeviceEnabled);
+		break;
+	case 5:
+		hierarchy(FAKEX_KEYBOARD, XISlaveKeyboard, XISlaveAdded);
+		break;
+	case 6:
+		hierarchy(FAKEX_KEYBOARD, XISlaveKeyboard, XIDeviceEnabled);
+		break;
+	case 7:
+		randr(RRScreenChangeNotify, FAKEX_ROOT, 1);
+		break;
+	case 8:
+		hierarchy(FAKEX_MOUSE, XISlavePointer, XIDeviceDisabled);
+		break;
+	case 9:
+		hierarchy(FAKEX_MOUSE, XISlavePointer, XISlaveRemoved);
+		break;
+	case 10:
+		hierarchy(FAKEX_KEYBOARD, XISlaveKeyboard, XIDeviceDisabled);
+		break;
+	case 11:
+		hierarchy(FAKEX_KEYBOARD, XISlaveKeyboard, XISlaveRemoved);
+		break;
+	case 12:
+		fakex_plug(0, 0);
+		randr(RRNotify_OutputChange, FAKEX_MONITOR, 0);
+		break;
+	case 13:
+		randr(RRNotify_CrtcChange, FAKEX_MONITOR_CRTC, 0);
+		break;
+	}
+}
+
+static int rm(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static int setup(void)
+{
+	char path[128];
+	FILE *fp;
+
+	snprintf(dir, sizeof(dir), "/tmp/xplugd-soak.XXXXXX");
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	setenv("HOME", dir, 1);
+	setenv("XDG_CONFIG_HOME", dir, 1);
+	setenv("XDG_RUNTIME_DIR", dir, 1);
+	snprintf(sockpath, sizeof(sockpath), "%s/%s", dir, SOCK_FILE);
+
+	snprintf(path, sizeof(path), "%s/%s", dir, CONF_FILE);
+	fp = fopen(path, "w");
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+	fputs(RULES, fp);
+	fclose(fp);
+
+	prognm   = "soak";
+	loglevel = LOG_WARNING;
+	openlog(prognm, LOG_PERROR, LOG_USER);
+	setlogmask(LOG_UPTO(loglevel));
+
+	exec_init();
+	profile_init();
+	conffile = config_file(CONF_FILE);
+
+	dpy = XOpenDisplay(NULL);
+	if (!dpy || !display_add(dpy)) {
+		fprintf(stderr, "Failed setting up the fake display\n");
+		return -1;
+	}
+
+	return sock_init();
+}
+
+int main(void)
+{
+	long start = 0, end, heap_start = 0, heap_end;
+	int fast, slow = -1;
+	int n, rc = 0;
+
+	if (setup())
+		return 1;
+
+#ifdef ASAN
+	printf("Built with ASan and LSan\n");
+#else
+	printf("Built without ASan and LSan, only RSS is checked\n");
+#endif
+
+	fast = client("subscribe");
+	if (fast == -1) {
+		perror("connect");
+		return 1;
+	}
+
+	for (n = 0; n < EVENTS; n++) {
+		/* Dropped when its queue is full, then back for more */
+		if (n % 1000 == 0) {
+			if (slow != -1)
+				close(slow);
+			slow = client("subscribe");
+		}
+
+		/* Layout profile for the docked setup, applied from now on */
+		if (n % STEPS == 1 && n < WARMUP)
+			send(fast, "layout HDMI-1 right-of eDP-1", 28, 0);
+		if (n == STEPS + 1)
+			send(fast, "save", 4, 0);
+
+		step(n);
+		loop_poll(0);
+		display_dispatch();
+		loop_poll(0);
+		drain(fast);
+
+		/* Nothing built for an event may outlive it */
+		if (arena_used()) {
+			printf("Arena not reset after event %d, %zu bytes used\n", n, arena_used());
+			rc = 1;
+			break;
+		}
+
+		if (n == WARMUP) {
+			start = rss();
+			heap_start = heap();
+		}
+	}
+	end = rss();
+	heap_end = heap();
+
+	printf("RSS after %d events %ld kiB, after %d events %ld kiB\n", WARMUP, start / 1024,
+	       EVENTS, end / 1024);
+#ifdef ASAN
+	printf("Heap after %d events %ld bytes, after %d events %ld bytes\n", WARMUP, heap_start,
+	       EVENTS, heap_end);
+	if (heap_end - heap_start > HEAP_SLACK) {
+		printf("Heap grew by %ld bytes, more than %d\n", heap_end - heap_start, HEAP_SLACK);
+		rc = 1;
+	}
+#else
+	if (end - start > SLACK) {
+		printf("RSS grew by %ld kiB, more than %d kiB\n", (end - start) / 1024, SLACK / 1024);
+		rc = 1;
+	}
+#endif
+
+	close(fast);
+	if (slow != -1)
+		close(slow);
+	nftw(dir, rm, 16, FTW_DEPTH | FTW_PHYS);
+
+	return rc;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
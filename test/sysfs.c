@@ -0,0 +1,170 @@
+/* Test sysfs EDID lookup against a fake /sys tree
+ *
+ * Copyright (C) 2016-2023  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Builds a fake DRM class directory, with the same connector on two
+ * cards, and checks which one, if any, the sysfs lookup picks.
+ */
+
+#define _XOPEN_SOURCE 700		/* nftw() */
+#include <ftw.h>
+#include <sys/stat.h>
+#include "xplugd.h"
+#include "edid.h"
+
+#define check(cond) do {						\
+		if (!(cond)) {						\
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			failed++;					\
+		}							\
+	} while (0)
+
+static char root[64];
+static int failed;
+
+static void edid(unsigned char *buf, unsigned char serial)
+{
+	static const unsigned char header[] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+	unsigned char sum = 0;
+
+	memset(buf, 0, EDID_BLOCK_LEN);
+	memcpy(buf, header, sizeof(header));
+	buf[0x0c] = serial;
+	for (int i = 0; i < EDID_BLOCK_LEN - 1; i++)
+		sum += buf[i];
+	buf[EDID_BLOCK_LEN - 1] = -sum;
+}
+
+static void put(const char *conn, const char *file, const void *data, size_t len)
+{
+	char path[256];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/class/drm/%s", root, conn);
+	mkdir(path, 0755);
+
+	snprintf(path, sizeof(path), "%s/class/drm/%s/%s", root, conn, file);
+	if (!data) {
+		unlink(path);
+		return;
+	}
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		perror(path);
+		exit(1);
+	}
+	fwrite(data, 1, len, fp);
+	fclose(fp);
+}
+
+static void connector(const char *conn, const char *status, const char *id, const unsigned char *data)
+{
+	put(conn, "status", status, strlen(status));
+	put(conn, "connector_id", id, id ? strlen(id) : 0);
+	put(conn, "edid", data, data ? EDID_BLOCK_LEN : 0);
+}
+
+static int rm(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+int main(void)
+{
+	unsigned char edid0[EDID_BLOCK_LEN], edid1[EDID_BLOCK_LEN], bad[EDID_BLOCK_LEN];
+	unsigned char buf[EDID_MAX_LEN];
+	char path[128];
+
+	snprintf(root, sizeof(root), "/tmp/xplugd-sysfs.XXXXXX");
+	if (!mkdtemp(root)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/class", root);
+	mkdir(path, 0755);
+	snprintf(path, sizeof(path), "%s/class/drm", root);
+	mkdir(path, 0755);
+
+	edid(edid0, 0x10);
+	edid(edid1, 0x11);
+	memcpy(bad, edid0, sizeof(bad));
+	bad[0x0c]++;
+
+	/* One GPU: modesetting and intel names, status, no such output */
+	connector("card0-HDMI-A-1", "connected\n", "70\n", edid0);
+	connector("card0-DP-1", "disconnected\n", "71\n", NULL);
+	connector("card0-DP-2", "connected\n", "72\n", bad);
+	check(sysfs_edid(root, "HDMI-1", 70, buf, sizeof(buf)) == EDID_BLOCK_LEN);
+	check(!memcmp(buf, edid0, EDID_BLOCK_LEN));
+	check(sysfs_edid(root, "HDMI1", 70, buf, sizeof(buf)) == EDID_BLOCK_LEN);
+	check(sysfs_edid(root, "DP-1", 71, buf, sizeof(buf)) == 0);
+	check(sysfs_edid(root, "DP-2", 72, buf, sizeof(buf)) == 0);
+	check(sysfs_edid(root, "VGA-1", 73, buf, sizeof(buf)) == 0);
+	check(sysfs_status(root, "HDMI-1", 70) == RR_Connected);
+	check(sysfs_status(root, "DP-1", 71) == RR_Disconnected);
+	check(sysfs_status(root, "VGA-1", 73) == -1);
+
+	/* No CONNECTOR_ID from the driver, the name alone is not enough */
+	check(sysfs_edid(root, "HDMI-1", 0, buf, sizeof(buf)) == 0);
+	check(sysfs_status(root, "HDMI-1", 0) == -1);
+
+	/* amdgpu numbers from zero, its DisplayPort-1 is card0-DP-2 */
+	connector("card0-DP-1", "connected\n", "71\n", edid1);
+	connector("card0-DP-2", "connected\n", "72\n", edid0);
+	check(sysfs_edid(root, "DisplayPort-1", 72, buf, sizeof(buf)) == 0);
+	connector("card0-DP-1", "disconnected\n", "71\n", NULL);
+	connector("card0-DP-2", "connected\n", "72\n", bad);
+
+	/* Second GPU with the same connector name */
+	connector("card1-HDMI-A-1", "connected\n", "77\n", edid1);
+	check(sysfs_edid(root, "HDMI-1", 0, buf, sizeof(buf)) == 0);
+	check(sysfs_edid(root, "HDMI-1", 70, buf, sizeof(buf)) == EDID_BLOCK_LEN);
+	check(!memcmp(buf, edid0, EDID_BLOCK_LEN));
+	check(sysfs_edid(root, "HDMI-1", 77, buf, sizeof(buf)) == EDID_BLOCK_LEN);
+	check(!memcmp(buf, edid1, EDID_BLOCK_LEN));
+	check(sysfs_edid(root, "HDMI-1", 99, buf, sizeof(buf)) == 0);
+	check(sysfs_status(root, "HDMI-1", 0) == -1);
+
+	/* Same connector id on both, or a kernel without connector_id */
+	connector("card1-HDMI-A-1", "connected\n", "70\n", edid1);
+	check(sysfs_edid(root, "HDMI-1", 70, buf, sizeof(buf)) == 0);
+	connector("card0-HDMI-A-1", "connected\n", NULL, edid0);
+	connector("card1-HDMI-A-1", "connected\n", NULL, edid1);
+	check(sysfs_edid(root, "HDMI-1", 70, buf, sizeof(buf)) == 0);
+	connector("card1-HDMI-A-1", "disconnected\n", NULL, NULL);
+	check(sysfs_edid(root, "HDMI-1", 70, buf, sizeof(buf)) == 0);
+
+	/* No sysfs at all */
+	check(sysfs_edid("/nonexistent", "HDMI-1", 0, buf, sizeof(buf)) == 0);
+
+	nftw(root, rm, 16, FTW_DEPTH | FTW_PHYS);
+
+	return failed ? 1 : 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */